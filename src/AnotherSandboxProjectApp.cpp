@@ -3,51 +3,88 @@
 #include "cinder/gl/gl.h"
 
 #include "cinder/audio/audio.h"
+#include "cinder/audio/dsp/Converter.h"
 
 #include "cinder/params/Params.h"
+#include "cinder/Utilities.h"
 #include "Utils.h"
+#include "RuleExplorer.h"
+#include <atomic>
+#include <mutex>
+#include <thread>
 
-#define OPENCL          1
-#define UNSAFEBUFFER    1
-#define FIXEDBUFFER     0
+#define BINARYCELLS     0
+#define OUTPUTCHANNELS  2
 
-#if OPENCL
-#include "DSPOpenCL.h"
-#else
-#include "DSPOpenGL.h"
-#endif
+#include "DSPEngines.h"
+#include "LatencyTuner.h"
+#include "DirectRenderer.h"
+#include "SharedOutputBus.h"
+#include "StreamRecorder.h"
 
 using namespace ci;
 using namespace ci::app;
 using namespace ci::audio;
 using namespace std;
 
+// the engine writes interleaved frames, audio::Buffer keeps one channel after another
 class ExternalDSPNode : public GenNode
 {
 protected:
-    RingBuffer* _ringBuffer;
-    DSPOpenCL* _controller;
+    DSPEngine* _controller;
+    DirectRenderer* _directRenderer;
+    SharedOutputBus* _outputBus;
+    StreamRecorder* _recorder;
+    std::vector<float> _frames;
+    
+    // interleaved staging for more than one channel, sized here and not on the audio thread
+    void initialize() override
+    {
+        _frames.resize(getFramesPerBlock() * getNumChannels());
+    }
     
 public:
-    ExternalDSPNode(RingBuffer* externalRingBuffer, DSPOpenCL* controller)
+    ExternalDSPNode(DSPEngine* controller, DirectRenderer* directRenderer, SharedOutputBus* outputBus, StreamRecorder* recorder) : GenNode(Node::Format().channels(controller->getChannelsCount()))
     {
-        _ringBuffer = externalRingBuffer;
         _controller = controller;
+        _directRenderer = directRenderer;
+        _outputBus = outputBus;
+        _recorder = recorder;
     }
     
     void process(audio::Buffer* buffer)
     {
-#if FIXEDBUFFER
-        _controller->generateSamples(buffer->getData());
-        return;
+        size_t channelsCount = buffer->getNumChannels();
+        float* data = buffer->getData();
+        if (channelsCount > 1)
+        {
+            if (buffer->getSize() > _frames.size())
+            {
+                buffer->zero();
+                return;
+            }
+            data = _frames.data();
+        }
+        
+        if (_directRenderer != NULL)
+        {
+#if LOGENABLED
+            if (!_directRenderer->read(data))
+                std::cerr << "[AudioThread]: BLOCKCONCEALED" << std::endl;
 #else
-        if (_ringBuffer)
+            _directRenderer->read(data);
+#endif
+        }
+        else if (_controller->getBlockMode() == DSPBlockFixed)
+        {
+            _controller->generateSamples(data);
+        }
+        else
         {
-            float* data = buffer->getData();
 #if LOGENABLED
             if (
 #endif
-            _ringBuffer->read(data, buffer->getNumFrames())
+            _controller->readRing(data, buffer->getSize())
 #if LOGENABLED
                 == false)
                 std::cerr << "[AudioThread]: BUFFERSKIP" << std::endl;
@@ -56,7 +93,11 @@ public:
 #endif
             
         }
-#endif
+        if (_outputBus != NULL)
+            _outputBus->write(data, buffer->getNumFrames());
+        _recorder->push(data, buffer->getNumFrames());
+        if (channelsCount > 1)
+            audio::dsp::deinterleave(data, buffer->getData(), buffer->getNumFrames(), channelsCount, buffer->getNumFrames());
     }
 };
 typedef std::shared_ptr<class ExternalDSPNode> ExternalDSPNodeRef;
@@ -65,11 +106,15 @@ typedef std::shared_ptr<class ExternalDSPNode> ExternalDSPNodeRef;
 class AnotherSandboxProjectApp : public App
 {
 protected:
-#if OPENCL
-    DSPOpenCL* _DSPController;
-#else
-    DSPOpenGL* _DSPController;
-#endif
+    DSPEngine* _DSPController;
+    // sets the ring fill in ring block mode, NULL in fixed block mode
+    LatencyTuner* _latencyTuner;
+    // renders ahead of the audio callback in direct block mode, NULL otherwise
+    DirectRenderer* _directRenderer;
+    // what the audio callback plays, for other processes, NULL without --bus
+    SharedOutputBus* _outputBus;
+    // what the audio callback plays, to disk
+    StreamRecorder* _recorder;
     ExternalDSPNodeRef externalDSPNode;
     
     GLuint _drawingScreenSizeLoc;
@@ -82,12 +127,23 @@ protected:
     GLuint _gridTex;
     GLuint _gridBuffer;
     
-    GLfloat* _gridData;
-    size_t _cellAttribCount;
     size_t _gridBufferLength;
     
     params::InterfaceGl _params;
     
+    // rule sweep running off the main thread, its ranking is stepped through with the keyboard
+    std::thread _explorerThread;
+    std::atomic<bool> _isExploring;
+    std::mutex _catalogueMutex;
+    std::vector<RuleCandidate> _catalogue;
+    size_t _catalogueIndex;
+    
+    PhiloxGenerator _random;
+    
+    DSPEngineSettings _engineSettings();
+    // controls only the OpenCL engine has, NULL for the other backends
+    DSPOpenCL* _openCLController();
+    
     void _prepareDrawingProgram();
     void _prepareDrawingBuffers();
     void _prepareDrawingVertexArray();
@@ -98,6 +154,9 @@ protected:
     void _clearField();
     void _randomField();
     void _randomAll();
+    void _exploreRules();
+    void _nextCatalogueRules();
+    void _toggleRecording();
     
   public:
     ~AnotherSandboxProjectApp();
@@ -120,8 +179,14 @@ protected:
 
 AnotherSandboxProjectApp::~AnotherSandboxProjectApp()
 {
+    if (_explorerThread.joinable())
+        _explorerThread.join();
+    
+    delete _latencyTuner;
+    delete _directRenderer;
+    delete _outputBus;
+    delete _recorder;
     delete _DSPController;
-    delete [] _gridData;
 
     glDeleteProgram(_drawingProgram);
     glDeleteShader(_drawingFragmentShader);
@@ -164,27 +229,14 @@ void AnotherSandboxProjectApp::_prepareDrawingProgram()
     
     _drawingScreenSizeLoc = glGetUniformLocation(_drawingProgram, "screenSize");
 }
+// the engine publishes snapshots on its own thread, only a new one is uploaded, DSPSampleType4 already is the RGBA32F texel
 void AnotherSandboxProjectApp::_updateGridState()
 {
-    if (!_gridData)
-    {
-        _gridData = new GLfloat[_gridBufferLength];
-        glGenBuffers(1, &_gridBuffer);
-    }
-    
-    const DSPSampleType4* gridState = _DSPController->getCurrentGridState();
-    for (size_t i = 0; i < _gridBufferLength; ++i)
-    {
-        int index = i / _cellAttribCount;
-        _gridData[i] = (GLfloat)gridState[index].s[i % _cellAttribCount];
-        bool replaceMask = _DSPController->DefferedUpdateGrid[index].s[0] > 0.0f ? 1.0f : 0.0f;
-        bool clearMask = _DSPController->DefferedUpdateGrid[index].s[0] < 0.0f ? 1.0f : 0.0f;
-        if (replaceMask || clearMask)
-            _gridData[i] = _DSPController->DefferedUpdateGrid[index].s[i % _cellAttribCount];
-    }
+    if (!_DSPController->updateGridSnapshot())
+        return;
 
     glBindBuffer(GL_ARRAY_BUFFER, _gridBuffer);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * _gridBufferLength, _gridData, GL_STATIC_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, _gridBufferLength, _DSPController->getGridSnapshot());
     glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 void AnotherSandboxProjectApp::_prepareDrawingBuffers()
@@ -201,10 +253,12 @@ void AnotherSandboxProjectApp::_prepareDrawingBuffers()
     glBufferData(GL_ARRAY_BUFFER, sizeof(plane), plane, GL_STATIC_DRAW);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     
-    _cellAttribCount = 4;
-    _gridBufferLength = _cellAttribCount * _DSPController->getCellsCount();
+    _gridBufferLength = sizeof(DSPSampleType4) * _DSPController->getCellsCount();
     
-    _gridData = NULL;
+    glGenBuffers(1, &_gridBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, _gridBuffer);
+    glBufferData(GL_ARRAY_BUFFER, _gridBufferLength, NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
     _updateGridState();
     
     glGenTextures(1, &_gridTex);
@@ -234,29 +288,120 @@ void AnotherSandboxProjectApp::_prepareDrawing()
     _prepareDrawingVertexArray();
 }
 
+// --backend=opencl|opengl|cpu|voices --ring=direct|staged --block=ring|fixed|direct --device=<index or name> --latency=<ms>
+// --voices=<voices sounding> --frames=<audio block frames> --bus=<shared memory name> --record=<path>, anything else keeps the default
+DSPEngineSettings AnotherSandboxProjectApp::_engineSettings()
+{
+    DSPEngineSettings settings;
+    settings.clDeviceCache = (getHomeDirectory() / "GPUDSP device.txt").string();
+#if BINARYCELLS
+    settings.cellsMode = CellsModeBinary;
+    settings.gridSize = ivec2(1024, 1024);
+#else
+    settings.channelsCount = OUTPUTCHANNELS;
+#endif
+    
+    for (const std::string& arg : getCommandLineArgs())
+    {
+        if (arg == "--backend=opencl")
+            settings.backend = DSPBackendOpenCL;
+        else if (arg == "--backend=opengl")
+            settings.backend = DSPBackendOpenGL;
+        else if (arg == "--backend=cpu")
+            settings.backend = DSPBackendCPU;
+        else if (arg == "--backend=voices")
+            settings.backend = DSPBackendVoices;
+        else if (arg.compare(0, 9, "--voices=") == 0)
+            settings.voicesCount = (size_t)std::max(1, atoi(arg.substr(9).c_str()));
+        else if (arg == "--ring=direct")
+            settings.ringMode = DSPRingDirect;
+        else if (arg == "--ring=staged")
+            settings.ringMode = DSPRingStaged;
+        else if (arg == "--block=ring")
+            settings.blockMode = DSPBlockRing;
+        else if (arg == "--block=fixed")
+            settings.blockMode = DSPBlockFixed;
+        else if (arg == "--block=direct")
+            settings.blockMode = DSPBlockDirect;
+        else if (arg.compare(0, 9, "--device=") == 0)
+            settings.clDevice = arg.substr(9);
+        else if (arg.compare(0, 10, "--latency=") == 0)
+            settings.latencyTarget = std::max(0.001, atof(arg.substr(10).c_str()) / 1000.0);
+    }
+    return settings;
+}
+
+DSPOpenCL* AnotherSandboxProjectApp::_openCLController()
+{
+    return dynamic_cast<DSPOpenCL*>(_DSPController);
+}
+
 void AnotherSandboxProjectApp::setup()
 {
-    srand(time(0));
+    _random = PhiloxGenerator((uint64_t)time(0));
+    _isExploring = false;
+    _catalogueIndex = 0;
     
     auto ctx = ci::audio::master();
     ci::audio::OutputNodeRef outputNode = ctx->getOutput();
     
-    const size_t sampleRate = outputNode->getSampleRate();
+    DSPEngineSettings settings = _engineSettings();
+    std::string outputBusName;
+    std::string recordingPath;
+    for (const std::string& arg : getCommandLineArgs())
+    {
+        // small device blocks are what brings direct block mode under a few milliseconds
+        if (arg.compare(0, 9, "--frames=") == 0)
+        {
+            auto outputDevice = std::dynamic_pointer_cast<OutputDeviceNode>(outputNode)->getDevice();
+            outputDevice->updateFormat(audio::Device::Format().framesPerBlock(std::max(16, atoi(arg.substr(9).c_str()))));
+        }
+        else if (arg.compare(0, 6, "--bus=") == 0)
+        {
+            outputBusName = arg.substr(6);
+        }
+        else if (arg.compare(0, 9, "--record=") == 0)
+        {
+            recordingPath = arg.substr(9);
+        }
+    }
+    settings.sampleRate = outputNode->getSampleRate();
     const size_t bufferSize = outputNode->getFramesPerBlock();
-#if FIXEDBUFFER
-    const size_t audioBuffersInGPUBuffer = 1;
-    const size_t GPUBuffersInRingBuffer = 1;
-#else
-    const size_t audioBuffersInGPUBuffer = 8;
-    const size_t GPUBuffersInRingBuffer = 3;
-#endif
-#if OPENCL
-    _DSPController = new DSPOpenCL(sampleRate, bufferSize * audioBuffersInGPUBuffer * GPUBuffersInRingBuffer);
-    externalDSPNode = ctx->makeNode(new ExternalDSPNode(&_DSPController->RingBuffer, _DSPController));
-#else
-    _DSPController = new DSPOpenGL(sampleRate, bufferSize * audioBuffersInGPUBuffer * GPUBuffersInRingBuffer);
-    externalDSPNode = ctx->makeNode(new ExternalDSPNode(&_DSPController->RingBuffer));
-#endif
+    const bool fixedBlocks = settings.blockMode != DSPBlockRing;
+    // the ring leaves the tuner room to grow the fill well past the target when the device cannot keep up
+    const size_t targetFrames = (size_t)(settings.latencyTarget * settings.sampleRate);
+    const size_t audioBuffersInRingBuffer = fixedBlocks ? 1 : std::max<size_t>(8, 4 * (targetFrames + bufferSize - 1) / bufferSize);
+    settings.bufferSize = bufferSize * audioBuffersInRingBuffer;
+    
+    _DSPController = createDSPEngine(settings);
+    _latencyTuner = NULL;
+    _directRenderer = NULL;
+    if (_DSPController->getBlockMode() == DSPBlockDirect)
+        _directRenderer = new DirectRenderer(_DSPController, settings.sampleRate);
+    if (_DSPController->getBlockMode() == DSPBlockRing)
+    {
+        LatencyTunerSettings tunerSettings;
+        tunerSettings.latencyTarget = settings.latencyTarget;
+        tunerSettings.audioBlock = bufferSize;
+        _latencyTuner = new LatencyTuner(settings.sampleRate, settings.bufferSize, tunerSettings);
+    }
+    std::cout << "[Engine]: " << getDSPBackendName(_DSPController->getBackend()) << std::endl;
+    _outputBus = NULL;
+    if (!outputBusName.empty())
+    {
+        // a second of audio, readers further behind than that lose frames
+        _outputBus = new SharedOutputBus();
+        if (!_outputBus->create(outputBusName[0] == '/' ? outputBusName : "/" + outputBusName, (uint32_t)settings.sampleRate, (uint32_t)_DSPController->getChannelsCount(), settings.sampleRate))
+        {
+            std::cerr << "[Bus]: cannot create " << outputBusName << std::endl;
+            delete _outputBus;
+            _outputBus = NULL;
+        }
+    }
+    _recorder = new StreamRecorder((uint32_t)settings.sampleRate, (uint32_t)_DSPController->getChannelsCount());
+    if (!recordingPath.empty())
+        _recorder->start(recordingPath);
+    externalDSPNode = ctx->makeNode(new ExternalDSPNode(_DSPController, _directRenderer, _outputBus, _recorder));
     ci::audio::GainNodeRef gainNode = ctx->makeNode(new GainNode(1.0));
     
     externalDSPNode >> gainNode >> outputNode;
@@ -272,10 +417,17 @@ void AnotherSandboxProjectApp::setup()
     _params.addParam("Rules: Keep center", _DSPController->rulesKeepCenter(), "min=-10.0 max=10.0 step=0.001");
     _params.addParam("Rules: Keep radius", _DSPController->rulesKeepRadius(), "min=0.0 max=10.0 step=0.001");
     _params.addParam("Rules: Speed", _DSPController->rulesSpeed(), "min=0.0 max=16.0 step=1.000");
+    if (DSPOpenCL* openCL = _openCLController())
+    {
+        _params.addParam<bool>("Rules: Quantized", [openCL](bool value) { openCL->setQuantized(value); }, [openCL]() { return openCL->getQuantized(); });
+        _params.addParam<int>("Rules: Radius", [openCL](int value) { openCL->setNeighbourhood(Neighbourhood(NeighbourhoodSquare, value)); }, [openCL]() { return (int)openCL->getNeighbourhood().radius; }).min(1).max(7);
+        _params.addParam<bool>("Rules: Ring kernel", [openCL](bool value) { if (value) openCL->setConvolutionKernel(ConvolutionKernel()); else openCL->resetConvolutionKernel(); }, [openCL]() { return openCL->getConvolution(); });
+        _params.addParam<int>("Samples per generation", [openCL](int value) { openCL->setControlRate(value, ControlCubic); }, [openCL]() { return (int)openCL->getSamplesPerGeneration(); }).min(1).max(256);
+        _params.addParam<bool>("Cycle replay", [openCL](bool value) { openCL->setCycleDetection(value); }, [openCL]() { return openCL->getCycleDetection(); });
+    }
     
-#if !FIXEDBUFFER
-    _DSPController->generateSamples();
-#endif
+    if (_latencyTuner != NULL)
+        _latencyTuner->generate(_DSPController);
 }
 
 
@@ -289,22 +441,70 @@ void AnotherSandboxProjectApp::_clearField()
 }
 void AnotherSandboxProjectApp::_randomField()
 {
-    for (size_t i = 0; i < _DSPController->getCellsCount(); ++i)
-    {
-        _DSPController->DefferedUpdateGrid[i].s[0] = randAmp();
-        _DSPController->DefferedUpdateGrid[i].s[1] = randFreq();
-    }
+    _DSPController->reseed(((uint64_t)_random.next() << 32) | _random.next());
+#if LOGENABLED
+    std::cout << "[Cells]: seed " << _DSPController->getSeed() << std::endl;
+#endif
 }
 void AnotherSandboxProjectApp::_randomAll()
 {
-    *_DSPController->getRulesBirthCenter() = -10.0 + (float)rand() / RAND_MAX * 20.0;
-    *_DSPController->rulesBirthRadius() = (float)rand() / RAND_MAX * 5.0;
-    *_DSPController->rulesKeepCenter() = -10.0 + (float)rand() / RAND_MAX * 20.0;
-    *_DSPController->rulesKeepRadius() = (float)rand() / RAND_MAX * 5.0;
+    *_DSPController->getRulesBirthCenter() = _random.nextUniform(-10.0f, 10.0f);
+    *_DSPController->rulesBirthRadius() = _random.nextUniform(0.0f, 5.0f);
+    *_DSPController->rulesKeepCenter() = _random.nextUniform(-10.0f, 10.0f);
+    *_DSPController->rulesKeepRadius() = _random.nextUniform(0.0f, 5.0f);
     
     _randomField();
 }
 
+void AnotherSandboxProjectApp::_exploreRules()
+{
+    if (_isExploring.exchange(true))
+        return;
+    if (_explorerThread.joinable())
+        _explorerThread.join();
+    
+    _explorerThread = std::thread([this]()
+    {
+        ThreadPool pool;
+        RuleExplorer explorer(RuleExplorerSettings(), &pool);
+        std::vector<RuleCandidate> catalogue = explorer.explore(2048, _random.getSeed() + 1);
+        RuleExplorer::writeCatalogue(catalogue, (getHomeDirectory() / "GPUDSP rules.csv").string());
+        {
+            std::lock_guard<std::mutex> lock(_catalogueMutex);
+            _catalogue = catalogue;
+            _catalogueIndex = 0;
+        }
+        _isExploring = false;
+    });
+}
+
+void AnotherSandboxProjectApp::_nextCatalogueRules()
+{
+    std::lock_guard<std::mutex> lock(_catalogueMutex);
+    if (_catalogue.empty())
+        return;
+    
+    const RuleCandidate& candidate = _catalogue[_catalogueIndex];
+    _catalogueIndex = (_catalogueIndex + 1) % _catalogue.size();
+    *_DSPController->getRulesBirthCenter() = candidate.rules[0];
+    *_DSPController->rulesBirthRadius() = candidate.rules[1];
+    *_DSPController->rulesKeepCenter() = candidate.rules[2];
+    *_DSPController->rulesKeepRadius() = candidate.rules[3];
+    *_DSPController->rulesSpeed() = candidate.rules[4];
+    _DSPController->reseed(candidate.seed);
+}
+
+void AnotherSandboxProjectApp::_toggleRecording()
+{
+    if (_recorder->isRecording())
+    {
+        _recorder->stop();
+        std::cout << "[Recorder]: stopped, " << _recorder->getDroppedFrames() << " frames dropped" << std::endl;
+        return;
+    }
+    _recorder->start((getHomeDirectory() / "GPUDSP recording").string());
+}
+
 void AnotherSandboxProjectApp::modifyCell(vec2 screenPos, float value)
 {
     ivec2 gridSize = _DSPController->getGridSize();
@@ -351,6 +551,36 @@ void AnotherSandboxProjectApp::keyDown( KeyEvent event )
         case KeyEvent::KEY_l:
             break;
             
+        case KeyEvent::KEY_e:
+            _exploreRules();
+            break;
+            
+        case KeyEvent::KEY_w:
+            _nextCatalogueRules();
+            break;
+            
+        case KeyEvent::KEY_f:
+            if (DSPOpenCL* openCL = _openCLController())
+                openCL->fastForward(10);
+            break;
+            
+        case KeyEvent::KEY_k:
+            if (DSPOpenCL* openCL = _openCLController())
+                openCL->saveSnapshot((getHomeDirectory() / "GPUDSP snapshot.gdss").string());
+            break;
+            
+        case KeyEvent::KEY_o:
+            if (DSPOpenCL* openCL = _openCLController())
+            {
+                if (!openCL->loadSnapshot((getHomeDirectory() / "GPUDSP snapshot.gdss").string()))
+                    std::cout << "[Snapshot]: no snapshot of this grid to restore" << std::endl;
+            }
+            break;
+            
+        case KeyEvent::KEY_v:
+            _toggleRecording();
+            break;
+            
         case KeyEvent::KEY_b:
             if (_params.isVisible())
                 _params.hide();
@@ -398,9 +628,8 @@ void AnotherSandboxProjectApp::mouseDown( MouseEvent event )
 
 void AnotherSandboxProjectApp::update()
 {
-#if !FIXEDBUFFER
-    _DSPController->generateSamples();
-#endif
+    if (_latencyTuner != NULL)
+        _latencyTuner->generate(_DSPController);
     
     _updateGridState();
 }
@@ -0,0 +1,209 @@
+//
+//  BinaryAutomaton.h
+//  GPUDSP
+//
+//  Bit-packed Life-like automaton, 64 cells per word.
+//
+
+#ifndef BinaryAutomaton_h
+#define BinaryAutomaton_h
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+//! Life-like rule: bit n of a mask is set when a cell with n live Moore neighbours is born / survives.
+struct BinaryRule
+{
+    uint32_t birthMask;
+    uint32_t keepMask;
+
+    BinaryRule() : birthMask(1 << 3), keepMask((1 << 2) | (1 << 3)) {}
+    BinaryRule(uint32_t birth, uint32_t keep) : birthMask(birth), keepMask(keep) {}
+
+    //! Parses "B3/S23" notation, returns Conway's rule for anything it does not understand.
+    static BinaryRule fromString(const std::string& rule)
+    {
+        BinaryRule result(0, 0);
+        uint32_t* mask = nullptr;
+        for (char c : rule)
+        {
+            if (c == 'B' || c == 'b')
+                mask = &result.birthMask;
+            else if (c == 'S' || c == 's')
+                mask = &result.keepMask;
+            else if (c >= '0' && c <= '8' && mask != nullptr)
+                *mask |= 1 << (c - '0');
+        }
+        if (result.birthMask == 0 && result.keepMask == 0)
+            return BinaryRule();
+        return result;
+    }
+
+    bool operator==(const BinaryRule& other) const
+    {
+        return birthMask == other.birthMask && keepMask == other.keepMask;
+    }
+
+    bool operator!=(const BinaryRule& other) const
+    {
+        return !(*this == other);
+    }
+};
+
+//! Toroidal binary grid, cell (x, y) is bit y % 64 of word x * wordsPerRow + y / 64.
+//! On little-endian hosts the words can be uploaded as-is to the 32-bit layout of BitCells.ncl.
+class BitGrid
+{
+protected:
+    size_t                  _rows;
+    size_t                  _wordsPerRow;
+    std::vector<uint64_t>   _words;
+    std::vector<uint64_t>   _nextWords;
+
+    static inline uint64_t _west(uint64_t word, uint64_t prevWord)
+    {
+        return (word << 1) | (prevWord >> 63);
+    }
+
+    static inline uint64_t _east(uint64_t word, uint64_t nextWord)
+    {
+        return (word >> 1) | (nextWord << 63);
+    }
+
+    // adds one bit plane into the 4-bit per-cell counter s0..s3
+    static inline void _add(uint64_t x, uint64_t& s0, uint64_t& s1, uint64_t& s2, uint64_t& s3)
+    {
+        uint64_t c0 = s0 & x; s0 ^= x;
+        uint64_t c1 = s1 & c0; s1 ^= c0;
+        uint64_t c2 = s2 & c1; s2 ^= c1;
+        s3 |= c2;
+    }
+
+public:
+    //! Grid height is rounded up to a multiple of 64 cells.
+    BitGrid(size_t rows, size_t rowLength) :
+    _rows(rows),
+    _wordsPerRow((rowLength + 63) / 64),
+    _words(rows * ((rowLength + 63) / 64), 0),
+    _nextWords(rows * ((rowLength + 63) / 64), 0)
+    {
+    }
+
+    size_t getRows() const
+    {
+        return _rows;
+    }
+
+    size_t getRowLength() const
+    {
+        return _wordsPerRow * 64;
+    }
+
+    size_t getWordsPerRow() const
+    {
+        return _wordsPerRow;
+    }
+
+    size_t getCellsCount() const
+    {
+        return _rows * _wordsPerRow * 64;
+    }
+
+    uint64_t* getWords()
+    {
+        return _words.data();
+    }
+
+    const uint64_t* getWords() const
+    {
+        return _words.data();
+    }
+
+    size_t getWordsCount() const
+    {
+        return _words.size();
+    }
+
+    bool get(size_t x, size_t y) const
+    {
+        return (_words[x * _wordsPerRow + y / 64] >> (y % 64)) & 1;
+    }
+
+    void set(size_t x, size_t y, bool alive = true)
+    {
+        uint64_t& word = _words[x * _wordsPerRow + y / 64];
+        uint64_t bit = (uint64_t)1 << (y % 64);
+        word = alive ? (word | bit) : (word & ~bit);
+    }
+
+    void clear()
+    {
+        std::fill(_words.begin(), _words.end(), 0);
+    }
+
+    size_t popcount() const
+    {
+        size_t count = 0;
+        for (uint64_t word : _words)
+            count += __builtin_popcountll(word);
+        return count;
+    }
+
+    //! Advances one generation, returns the live cells count of the new generation.
+    size_t step(const BinaryRule& rule)
+    {
+        size_t count = 0;
+        for (size_t x = 0; x < _rows; ++x)
+        {
+            const uint64_t* up = &_words[(x == 0 ? _rows - 1 : x - 1) * _wordsPerRow];
+            const uint64_t* row = &_words[x * _wordsPerRow];
+            const uint64_t* down = &_words[(x + 1 == _rows ? 0 : x + 1) * _wordsPerRow];
+            uint64_t* next = &_nextWords[x * _wordsPerRow];
+
+            for (size_t w = 0; w < _wordsPerRow; ++w)
+            {
+                size_t prev = w == 0 ? _wordsPerRow - 1 : w - 1;
+                size_t following = w + 1 == _wordsPerRow ? 0 : w + 1;
+
+                uint64_t s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+                _add(_west(up[w], up[prev]), s0, s1, s2, s3);
+                _add(up[w], s0, s1, s2, s3);
+                _add(_east(up[w], up[following]), s0, s1, s2, s3);
+                _add(_west(row[w], row[prev]), s0, s1, s2, s3);
+                _add(_east(row[w], row[following]), s0, s1, s2, s3);
+                _add(_west(down[w], down[prev]), s0, s1, s2, s3);
+                _add(down[w], s0, s1, s2, s3);
+                _add(_east(down[w], down[following]), s0, s1, s2, s3);
+
+                uint64_t alive = row[w];
+                uint64_t result = 0;
+                for (uint32_t n = 0; n <= 8; ++n)
+                {
+                    uint32_t outcome = (((rule.birthMask >> n) & 1) << 0) | (((rule.keepMask >> n) & 1) << 1);
+                    if (outcome == 0)
+                        continue;
+
+                    uint64_t equal = (n & 1 ? s0 : ~s0) & (n & 2 ? s1 : ~s1) & (n & 4 ? s2 : ~s2) & (n & 8 ? s3 : ~s3);
+                    uint64_t target = outcome == 3 ? ~(uint64_t)0 : (outcome == 2 ? alive : ~alive);
+                    result |= equal & target;
+                }
+                next[w] = result;
+                count += __builtin_popcountll(result);
+            }
+        }
+        _words.swap(_nextWords);
+        return count;
+    }
+
+    //! Advances \a count generations writing the live cells density of each one as a -1..1 sample.
+    void render(float* samples, size_t count, const BinaryRule& rule)
+    {
+        float scale = 2.0f / (float)getCellsCount();
+        for (size_t i = 0; i < count; ++i)
+            samples[i] = (float)step(rule) * scale - 1.0f;
+    }
+};
+
+#endif /* BinaryAutomaton_h */
@@ -0,0 +1,276 @@
+//
+//  BroadcastRingBuffer.h
+//  GPUDSP
+//
+//  Single producer ring read by several consumers, each with its own cursor, every one of them reading in place.
+//
+
+#ifndef BroadcastRingBuffer_h
+#define BroadcastRingBuffer_h
+
+#include "RingCursor.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+enum RingReaderMode
+{
+    RingReaderLossless, // holds the writer back until it has read, the audio callback
+    RingReaderLossy     // never holds the writer back, skips what it was too slow for, recorders and meters
+};
+
+//! Single producer ring interface with write, read and in place writes, with reader 0 as the reader its read calls mean.
+//! Element n lives in slot n % size, the cursors count elements since the start. Lossy readers lapped by the writer
+//! skip ahead by whole granules, so a ring of interleaved frames stays on frame boundaries.
+template <typename T>
+class BroadcastRingBufferT
+{
+public:
+    static const int maxReaders = 8;
+
+protected:
+    enum ReaderState
+    {
+        ReaderFree,
+        ReaderLossless,
+        ReaderLossy
+    };
+
+    struct Cursor
+    {
+        std::atomic<uint64_t>   index;
+        std::atomic<uint64_t>   dropped;
+        std::atomic<int>        state;
+    };
+
+    std::vector<T>          _data;
+    size_t                  _granule;
+    std::atomic<uint64_t>   _writeIndex;
+    std::atomic<uint64_t>   _writingIndex;  // end of the elements being written, lossy readers do not trust their slots
+    Cursor                  _cursors[maxReaders];
+
+    uint64_t _getOldestLossless() const
+    {
+        uint64_t oldest = _writeIndex.load(std::memory_order_relaxed);
+        for (const Cursor& cursor : _cursors)
+        {
+            if (cursor.state.load(std::memory_order_acquire) == ReaderLossless)
+                oldest = std::min(oldest, cursor.index.load(std::memory_order_acquire));
+        }
+        return oldest;
+    }
+
+    void _catchUp(Cursor& cursor, uint64_t writeIndex)
+    {
+        uint64_t index = cursor.index.load(std::memory_order_relaxed);
+        uint64_t skipTo = catchUpRingCursor(index, writeIndex, _data.size(), _granule);
+        if (skipTo == index)
+            return;
+        cursor.dropped.fetch_add(skipTo - index, std::memory_order_relaxed);
+        cursor.index.store(skipTo, std::memory_order_release);
+    }
+
+    void _publish(uint64_t writeIndex, size_t count)
+    {
+        _writeIndex.store(writeIndex + count, std::memory_order_release);
+    }
+
+public:
+    //! A ring of \a count elements, \a granule elements to a frame. Reader 0 is there from the start, lossless.
+    BroadcastRingBufferT(size_t count, size_t granule = 1) : _data(count), _granule(std::max<size_t>(1, granule)), _writeIndex(0), _writingIndex(0)
+    {
+        for (Cursor& cursor : _cursors)
+        {
+            cursor.index = 0;
+            cursor.dropped = 0;
+            cursor.state = ReaderFree;
+        }
+        _cursors[0].state = ReaderLossless;
+    }
+
+    //! Returns the maximum number of elements.
+    size_t getSize() const
+    {
+        return _data.size();
+    }
+
+    //! \name Write side, only safe to call from the write thread
+    //! \{
+
+    //! Elements that fit before the oldest lossless reader, lossy readers do not count.
+    size_t getAvailableWrite() const
+    {
+        return _data.size() - (size_t)(_writeIndex.load(std::memory_order_relaxed) - _getOldestLossless());
+    }
+
+    //! \return `false` and writes nothing if \a count elements do not fit.
+    bool write(const T* array, size_t count)
+    {
+        T* firstPart = nullptr;
+        T* secondPart = nullptr;
+        size_t firstLength = 0;
+        size_t secondLength = 0;
+        getUnsafeDataWritePointer(count, firstPart, secondPart, firstLength, secondLength);
+        if (firstPart == nullptr)
+            return count == 0;
+
+        std::memcpy(firstPart, array, firstLength * sizeof(T));
+        if (secondPart != nullptr)
+            std::memcpy(secondPart, array + firstLength, secondLength * sizeof(T));
+        commitUnsafeDataWrite(count);
+        return true;
+    }
+
+    //! Points \a firstPart and \a secondPart at the next \a count free elements, or both at nullptr if there are fewer.
+    //! Lossy readers stop trusting these slots from here on, the elements reach readers at commitUnsafeDataWrite(count).
+    void getUnsafeDataWritePointer(size_t count, T*& firstPart, T*& secondPart, size_t& firstLength, size_t& secondLength)
+    {
+        firstPart = nullptr;
+        secondPart = nullptr;
+        firstLength = 0;
+        secondLength = 0;
+        if (count == 0 || count > getAvailableWrite())
+            return;
+
+        uint64_t writeIndex = _writeIndex.load(std::memory_order_relaxed);
+        _writingIndex.store(writeIndex + count, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        size_t slot = (size_t)(writeIndex % _data.size());
+        firstPart = &_data[slot];
+        firstLength = std::min(count, _data.size() - slot);
+        secondLength = count - firstLength;
+        secondPart = secondLength > 0 ? &_data[0] : nullptr;
+    }
+
+    void commitUnsafeDataWrite(size_t count)
+    {
+        _publish(_writeIndex.load(std::memory_order_relaxed), count);
+    }
+    //! \}
+
+    //! \name Reader 0, only safe to call from its thread
+    //! \{
+    size_t getAvailableRead()
+    {
+        return getAvailableRead(0);
+    }
+
+    //! \return `false` and reads nothing if there are fewer than \a count elements.
+    bool read(T* array, size_t count)
+    {
+        return read(0, array, count);
+    }
+    //! \}
+
+    //! \name Readers, each only safe to call from the thread reading with it
+    //! \{
+
+    //! Adds a reader starting at the newest element. \return its index, or -1 if all maxReaders are taken.
+    //! Safe from any thread.
+    int addReader(RingReaderMode mode)
+    {
+        for (int reader = 1; reader < maxReaders; ++reader)
+        {
+            int state = ReaderFree;
+            Cursor& cursor = _cursors[reader];
+            // claimed lossy first, so the writer never waits on a cursor that is not set yet
+            if (!cursor.state.compare_exchange_strong(state, ReaderLossy))
+                continue;
+            cursor.index.store(_writeIndex.load(std::memory_order_acquire), std::memory_order_release);
+            cursor.dropped = 0;
+            setReaderMode(reader, mode);
+            return reader;
+        }
+        return -1;
+    }
+
+    void removeReader(int reader)
+    {
+        if (reader > 0)
+            _cursors[reader].state.store(ReaderFree, std::memory_order_release);
+    }
+
+    //! A lossless reader turned lossy stops holding the writer back at once, a lapped lossy one turned lossless
+    //! first skips to where the writer has to wait for it.
+    void setReaderMode(int reader, RingReaderMode mode)
+    {
+        Cursor& cursor = _cursors[reader];
+        if (mode == RingReaderLossless)
+            _catchUp(cursor, _writeIndex.load(std::memory_order_acquire));
+        cursor.state.store(mode == RingReaderLossless ? ReaderLossless : ReaderLossy, std::memory_order_release);
+    }
+
+    //! Readers besides reader 0.
+    int getExtraReadersCount() const
+    {
+        int count = 0;
+        for (int reader = 1; reader < maxReaders; ++reader)
+            count += _cursors[reader].state.load(std::memory_order_relaxed) != ReaderFree;
+        return count;
+    }
+
+    size_t getAvailableRead(int reader)
+    {
+        Cursor& cursor = _cursors[reader];
+        uint64_t writeIndex = _writeIndex.load(std::memory_order_acquire);
+        if (cursor.state.load(std::memory_order_relaxed) == ReaderLossy)
+            _catchUp(cursor, writeIndex);
+        return (size_t)(writeIndex - cursor.index.load(std::memory_order_relaxed));
+    }
+
+    //! Points \a firstPart and \a secondPart straight into the ring at up to \a count unread elements, secondPart is
+    //! nullptr unless they wrap. \return elements pointed at, consume moves past them.
+    size_t peek(int reader, size_t count, const T*& firstPart, size_t& firstLength, const T*& secondPart, size_t& secondLength)
+    {
+        count = std::min(count, getAvailableRead(reader));
+        size_t slot = (size_t)(_cursors[reader].index.load(std::memory_order_relaxed) % _data.size());
+        firstPart = &_data[slot];
+        firstLength = std::min(count, _data.size() - slot);
+        secondLength = count - firstLength;
+        secondPart = secondLength > 0 ? &_data[0] : nullptr;
+        return count;
+    }
+
+    //! Moves past \a count peeked elements. \return `false` if a lossy reader was lapped while it used them, the writer
+    //! never touches what a lossless reader has not consumed.
+    bool consume(int reader, size_t count)
+    {
+        Cursor& cursor = _cursors[reader];
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint64_t index = cursor.index.load(std::memory_order_relaxed);
+        bool isIntact = _writingIndex.load(std::memory_order_relaxed) <= index + _data.size();
+        if (!isIntact)
+            cursor.dropped.fetch_add(count, std::memory_order_relaxed);
+        cursor.index.store(index + count, std::memory_order_release);
+        return isIntact;
+    }
+
+    //! Copies \a count elements out and moves past them. \return `false` and reads nothing if there are fewer, or if
+    //! a lossy reader was lapped during the copy, which then counts them as dropped.
+    bool read(int reader, T* array, size_t count)
+    {
+        const T* firstPart = nullptr;
+        const T* secondPart = nullptr;
+        size_t firstLength = 0;
+        size_t secondLength = 0;
+        if (count == 0 || peek(reader, count, firstPart, firstLength, secondPart, secondLength) < count)
+            return count == 0;
+
+        std::memcpy(array, firstPart, firstLength * sizeof(T));
+        if (secondPart != nullptr)
+            std::memcpy(array + firstLength, secondPart, secondLength * sizeof(T));
+        return consume(reader, count);
+    }
+
+    //! Elements a lossy reader skipped or lost to the writer.
+    uint64_t getDroppedCount(int reader) const
+    {
+        return _cursors[reader].dropped.load(std::memory_order_relaxed);
+    }
+    //! \}
+};
+
+#endif /* BroadcastRingBuffer_h */
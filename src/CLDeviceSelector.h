@@ -0,0 +1,160 @@
+//
+//  CLDeviceSelector.h
+//  GPUDSP
+//
+//  Picks the OpenCL device the engines run on by timing a short render on each, with an override and a cached pick.
+//
+
+#ifndef CLDeviceSelector_h
+#define CLDeviceSelector_h
+
+#include "DSPOpenCL.h"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <utility>
+
+struct CLDeviceSelectorSettings
+{
+    std::string     override;                   // device index in listCLDevices order or part of its name, empty benchmarks
+    std::string     cachePath;                  // keeps the pick for the same workload and drivers, empty does not cache
+    size_t          sampleRate = 44100;
+    size_t          bufferSize = 4096;
+    size_t          channelsCount = 1;
+    glm::ivec2      gridSize = glm::ivec2(16, 16);
+    CellsMode       cellsMode = CellsModeContinuous;
+    double          latencyBudget = 0.0;        // seconds a block may take, 0 allows half of its duration
+    size_t          blocks = 8;                 // timed blocks per device, after one untimed warm-up block
+};
+
+struct CLDeviceBenchmark
+{
+    CLDevice        device;
+    double          blockTime;                  // median seconds per block, infinity if the engine did not build
+};
+
+//! Renders the settings workload on \a device through a whole DSPOpenCL, cells, mixdown and read back included.
+//! Leaves \a device selected.
+inline CLDeviceBenchmark benchmarkCLDevice(const CLDevice& device, const CLDeviceSelectorSettings& settings)
+{
+    CLDeviceBenchmark benchmark = { device, std::numeric_limits<double>::infinity() };
+    setCLDevice(device.deviceID);
+    DSPOpenCL engine(settings.sampleRate, settings.bufferSize, settings.cellsMode, settings.gridSize, settings.channelsCount, 1);
+    if (!engine.isReady())
+        return benchmark;
+
+    engine.setBlockMode(DSPBlockFixed);
+    std::vector<float> block(settings.bufferSize * engine.getChannelsCount());
+    engine.generateSamples(block.data());
+
+    std::vector<double> times;
+    for (size_t i = 0; i < std::max<size_t>(1, settings.blocks); ++i)
+    {
+        auto start = std::chrono::steady_clock::now();
+        engine.generateSamples(block.data());
+        times.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+    std::nth_element(times.begin(), times.begin() + times.size() / 2, times.end());
+    benchmark.blockTime = times[times.size() / 2];
+    return benchmark;
+}
+
+// the workload and the device with its driver, a pick is only reused while all of them match
+inline std::string _clDeviceCacheKey(const CLDevice& device, const CLDeviceSelectorSettings& settings)
+{
+    std::stringstream key;
+    key << settings.gridSize.x << "x" << settings.gridSize.y << " " << settings.cellsMode << " " << settings.bufferSize << " "
+        << settings.channelsCount << "\t" << device.platform << "\t" << device.name << "\t" << device.driver;
+    return key.str();
+}
+
+inline const CLDevice* _findCLDeviceOverride(const std::vector<CLDevice>& devices, const std::string& override)
+{
+    if (!override.empty() && std::all_of(override.begin(), override.end(), ::isdigit))
+    {
+        size_t index = (size_t)std::stoul(override);
+        return index < devices.size() ? &devices[index] : NULL;
+    }
+    for (const CLDevice& device : devices)
+    {
+        if (device.name.find(override) != std::string::npos)
+            return &device;
+    }
+    return NULL;
+}
+
+//! Selects the device for every engine created afterwards and returns it, NULL if no device can run the engine.
+//! The override wins, then a cached pick, then the fastest device within the latency budget, or the fastest at all if none is.
+inline cl_device_id selectCLDevice(const CLDeviceSelectorSettings& settings)
+{
+    std::vector<CLDevice> devices = listCLDevices();
+    setCLDevice(NULL);
+    if (devices.empty())
+        return NULL;
+
+    if (!settings.override.empty())
+    {
+        const CLDevice* device = _findCLDeviceOverride(devices, settings.override);
+        if (device != NULL)
+        {
+            setCLDevice(device->deviceID);
+            return device->deviceID;
+        }
+#if LOGENABLED
+        std::cerr << "[OpenCL]: no device matches " << settings.override << ", benchmarking" << std::endl;
+#endif
+    }
+
+    if (!settings.cachePath.empty())
+    {
+        std::ifstream cache(settings.cachePath);
+        std::string cachedKey;
+        std::getline(cache, cachedKey);
+        for (const CLDevice& device : devices)
+        {
+            if (cache && _clDeviceCacheKey(device, settings) == cachedKey)
+            {
+                setCLDevice(device.deviceID);
+                return device.deviceID;
+            }
+        }
+    }
+
+    double budget = settings.latencyBudget > 0.0 ? settings.latencyBudget : 0.5 * (double)settings.bufferSize / (double)settings.sampleRate;
+    // a device within the budget always beats one outside of it
+    auto rank = [budget](const CLDeviceBenchmark& benchmark) { return std::make_pair(benchmark.blockTime > budget, benchmark.blockTime); };
+    const CLDeviceBenchmark* best = NULL;
+    std::vector<CLDeviceBenchmark> benchmarks;
+    for (const CLDevice& device : devices)
+        benchmarks.push_back(benchmarkCLDevice(device, settings));
+    for (const CLDeviceBenchmark& benchmark : benchmarks)
+    {
+#if LOGENABLED
+        std::cout << "[OpenCL]: " << benchmark.device.platform << " / " << benchmark.device.name << ": " << benchmark.blockTime * 1000.0 << " ms per block" << std::endl;
+#endif
+        if (benchmark.blockTime == std::numeric_limits<double>::infinity())
+            continue;
+        if (best == NULL || rank(benchmark) < rank(*best))
+            best = &benchmark;
+    }
+
+    if (best == NULL)
+    {
+        setCLDevice(NULL);
+        return NULL;
+    }
+#if LOGENABLED
+    if (best->blockTime > budget)
+        std::cerr << "[OpenCL]: no device renders a block within " << budget * 1000.0 << " ms" << std::endl;
+#endif
+
+    if (!settings.cachePath.empty())
+        std::ofstream(settings.cachePath) << _clDeviceCacheKey(best->device, settings) << std::endl;
+    setCLDevice(best->device.deviceID);
+    return best->device.deviceID;
+}
+
+#endif /* CLDeviceSelector_h */
@@ -0,0 +1,515 @@
+//
+//  CellsCPU.h
+//  GPUDSP
+//
+//  Host implementation of the continuous automaton in Cells.ncl.
+//
+
+#ifndef CellsCPU_h
+#define CellsCPU_h
+
+#include "Convolution.h"
+#include "Neighbourhood.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+//! Host mirror of the sign/fabs/clamp rule in Cells.ncl, rules are birth center/radius, keep center/radius, speed.
+inline float cellsRuleNextState(const float* rules, float state, float sum, float deltaValue)
+{
+    float birth = rules[1] - fabsf(sum - rules[0]) >= 0.0f ? 1.0f : 0.0f;
+    float keep = rules[3] - fabsf(sum - rules[2]) >= 0.0f ? 1.0f : 0.0f;
+    float deltaSign = fminf(fmaxf(-1.0f + 2.0f * birth + keep, -1.0f), 1.0f);
+    return fminf(fmaxf(state + deltaSign * deltaValue, 0.0f), 1.0f);
+}
+
+inline float cellsRuleDelta(const float* rules)
+{
+    return 1.0f / powf(2.0f, floorf(rules[4]));
+}
+
+//! Continuous grid, cell (x, y) at x * height + y, stored with a one cell halo of ghost cells that the boundary mode
+//! refreshes once per generation so the stencil reads its neighbours without wrapping. Quiet tiles are skipped: a tile is
+//! evaluated only if it or one of its eight neighbour tiles changed in the previous generation, and its mixdown sum is reused otherwise.
+class CellsCPU
+{
+protected:
+    size_t              _width;
+    size_t              _height;
+    size_t              _stride;
+    size_t              _tileSize;
+    size_t              _tilesX;
+    size_t              _tilesY;
+
+    // (width + 2) x (height + 2) with the halo, interior cell (x, y) at (x + 1) * _stride + y + 1
+    std::vector<float>  _state;
+    std::vector<float>  _nextState;
+    std::vector<float>  _tileSums;
+    std::vector<uint8_t> _tileChanged;
+    std::vector<uint8_t> _nextTileChanged;
+    size_t              _activeTiles;
+
+    BoundaryMode        _boundaryMode;
+    float               _boundaryValue;
+
+    float               _rules[5];
+    const float*        _ruleTable;
+    uint32_t            _ruleTableLevels;
+
+    ConvolutionCPU*     _convolution;
+    Neighbourhood       _neighbourhood;
+    WindowSumsCPU       _windowSums;
+    std::vector<float>  _plain;
+    std::vector<float>  _sums;
+
+    ThreadPool*         _pool;
+    size_t              _blockGenerations;
+    size_t              _blockSize;
+    std::vector<float>  _blockPartials;
+    std::vector<float>  _renderSums;
+
+    size_t _index(size_t x, size_t y) const
+    {
+        return (x + 1) * _stride + y + 1;
+    }
+
+    void _refreshHalo(std::vector<float>& grid)
+    {
+        int width = (int)_width;
+        int height = (int)_height;
+        int left = boundaryIndex(-1, height, _boundaryMode);
+        int right = boundaryIndex(height, height, _boundaryMode);
+        for (size_t x = 0; x < _width; ++x)
+        {
+            float* row = &grid[(x + 1) * _stride + 1];
+            row[-1] = left < 0 ? _boundaryValue : row[left];
+            row[_height] = right < 0 ? _boundaryValue : row[right];
+        }
+
+        // whole padded rows, corners included
+        int top = boundaryIndex(-1, width, _boundaryMode);
+        int bottom = boundaryIndex(width, width, _boundaryMode);
+        if (top < 0)
+            std::fill(grid.begin(), grid.begin() + _stride, _boundaryValue);
+        else
+            std::copy(grid.begin() + (top + 1) * _stride, grid.begin() + (top + 2) * _stride, grid.begin());
+        if (bottom < 0)
+            std::fill(grid.end() - _stride, grid.end(), _boundaryValue);
+        else
+            std::copy(grid.begin() + (bottom + 1) * _stride, grid.begin() + (bottom + 2) * _stride, grid.end() - _stride);
+    }
+
+    bool _isTileActive(size_t tx, size_t ty) const
+    {
+        // tiles wrap whatever the boundary, which only errs on the side of evaluating
+        for (int i = -1; i <= 1; ++i)
+        {
+            size_t nx = (tx + _tilesX + i) % _tilesX;
+            for (int j = -1; j <= 1; ++j)
+            {
+                size_t ny = (ty + _tilesY + j) % _tilesY;
+                if (_tileChanged[nx * _tilesY + ny])
+                    return true;
+            }
+        }
+        return false;
+    }
+
+    float _ruleState(float cell, float sum, float deltaValue) const
+    {
+        if (_ruleTableLevels > 0)
+        {
+            float scale = (float)(_ruleTableLevels - 1);
+            uint32_t sumLevels = 8 * (_ruleTableLevels - 1) + 1;
+            uint32_t stateLevel = std::min((uint32_t)(cell * scale + 0.5f), _ruleTableLevels - 1);
+            uint32_t sumLevel = std::min((uint32_t)(fmaxf(sum, 0.0f) * scale + 0.5f), sumLevels - 1);
+            return _ruleTable[stateLevel * sumLevels + sumLevel];
+        }
+        return cellsRuleNextState(_rules, cell, sum, deltaValue);
+    }
+
+    float _stepTile(size_t tx, size_t ty, float deltaValue, bool& changed)
+    {
+        float sum = 0.0f;
+        size_t xEnd = std::min(_width, (tx + 1) * _tileSize);
+        size_t yEnd = std::min(_height, (ty + 1) * _tileSize);
+        for (size_t x = tx * _tileSize; x < xEnd; ++x)
+        {
+            const float* up = &_state[_index(x, 0) - _stride];
+            const float* row = &_state[_index(x, 0)];
+            const float* down = &_state[_index(x, 0) + _stride];
+            float* next = &_nextState[_index(x, 0)];
+            for (size_t y = ty * _tileSize; y < yEnd; ++y)
+            {
+                float neighbours = up[y - 1] + up[y] + up[y + 1] + row[y - 1] + row[y + 1] + down[y - 1] + down[y] + down[y + 1];
+                float value = _ruleState(row[y], neighbours, deltaValue);
+                changed |= value != row[y];
+                next[y] = value;
+                sum += value;
+            }
+        }
+        return sum;
+    }
+
+    // wide neighbourhoods reach past neighbour tiles, so every cell is evaluated and every tile counts as changed
+    void _stepSummed(float deltaValue)
+    {
+        copyState(_plain.data());
+        if (_convolution != nullptr)
+            _convolution->convolve(_plain.data(), _sums.data());
+        else
+            _windowSums.compute(_plain.data(), _sums.data(), _neighbourhood, 8.0f);
+        for (size_t x = 0; x < _width; ++x)
+            for (size_t y = 0; y < _height; ++y)
+                _nextState[_index(x, y)] = _ruleState(_plain[x * _height + y], _sums[x * _height + y], deltaValue);
+        _refreshHalo(_nextState);
+        _state.swap(_nextState);
+        _activeTiles = _tilesX * _tilesY;
+        touch();
+    }
+
+    // overlapped tiles only stay exact where the margin past an edge holds the very cells step reads, summed in the same
+    // order, which rules out reflecting boundaries: a mirrored margin cell sums its neighbourhood mirrored and rounds differently
+    bool _canBlock(size_t generations) const
+    {
+        return generations > 1 && _convolution == nullptr && _neighbourhood.isStencil()
+            && _boundaryMode == BoundaryTorus && generations < std::min(_width, _height);
+    }
+
+    // one tile advanced \a generations at once: the tile and a margin of that many cells are loaded, the valid
+    // region shrinks by a cell per generation, and the core sum of every generation goes to \a partials
+    void _advanceTile(size_t tx, size_t ty, size_t generations, float deltaValue, float* partials)
+    {
+        static thread_local std::vector<float> current;
+        static thread_local std::vector<float> next;
+
+        size_t x0 = tx * _blockSize;
+        size_t y0 = ty * _blockSize;
+        size_t coreWidth = std::min(_blockSize, _width - x0);
+        size_t coreHeight = std::min(_blockSize, _height - y0);
+        size_t sideX = coreWidth + 2 * generations;
+        size_t sideY = coreHeight + 2 * generations;
+        current.resize(sideX * sideY);
+        next.resize(sideX * sideY);
+
+        for (size_t i = 0; i < sideX; ++i)
+        {
+            size_t x = boundaryIndex((int)x0 - (int)generations + (int)i, (int)_width, _boundaryMode);
+            for (size_t j = 0; j < sideY; ++j)
+                current[i * sideY + j] = _state[_index(x, boundaryIndex((int)y0 - (int)generations + (int)j, (int)_height, _boundaryMode))];
+        }
+
+        for (size_t g = 1; g <= generations; ++g)
+        {
+            float sum = 0.0f;
+            for (size_t i = g; i < sideX - g; ++i)
+            {
+                const float* up = &current[(i - 1) * sideY];
+                const float* row = &current[i * sideY];
+                const float* down = &current[(i + 1) * sideY];
+                float* target = &next[i * sideY];
+                bool isCoreRow = i >= generations && i < generations + coreWidth;
+                for (size_t j = g; j < sideY - g; ++j)
+                {
+                    float neighbours = up[j - 1] + up[j] + up[j + 1] + row[j - 1] + row[j + 1] + down[j - 1] + down[j] + down[j + 1];
+                    target[j] = _ruleState(row[j], neighbours, deltaValue);
+                }
+                if (isCoreRow)
+                    for (size_t j = generations; j < generations + coreHeight; ++j)
+                        sum += target[j];
+            }
+            partials[g - 1] = sum;
+            current.swap(next);
+        }
+
+        for (size_t i = 0; i < coreWidth; ++i)
+            for (size_t j = 0; j < coreHeight; ++j)
+                _nextState[_index(x0 + i, y0 + j)] = current[(i + generations) * sideY + j + generations];
+    }
+
+    void _advanceBlock(size_t generations, float* sums)
+    {
+        float deltaValue = cellsRuleDelta(_rules);
+        size_t tilesX = (_width + _blockSize - 1) / _blockSize;
+        size_t tilesY = (_height + _blockSize - 1) / _blockSize;
+        size_t tilesCount = tilesX * tilesY;
+        _blockPartials.assign(tilesCount * generations, 0.0f);
+
+        auto advanceTile = [&](size_t tile)
+        {
+            _advanceTile(tile / tilesY, tile % tilesY, generations, deltaValue, &_blockPartials[tile * generations]);
+        };
+        if (_pool != nullptr)
+            _pool->parallelFor(tilesCount, advanceTile);
+        else
+            for (size_t tile = 0; tile < tilesCount; ++tile)
+                advanceTile(tile);
+
+        for (size_t g = 0; g < generations; ++g)
+        {
+            sums[g] = 0.0f;
+            for (size_t tile = 0; tile < tilesCount; ++tile)
+                sums[g] += _blockPartials[tile * generations + g];
+        }
+
+        _refreshHalo(_nextState);
+        _state.swap(_nextState);
+        _activeTiles = _tilesX * _tilesY;
+        touch();
+    }
+
+public:
+    CellsCPU(size_t width, size_t height, size_t tileSize = 8) :
+    _width(width),
+    _height(height),
+    _stride(height + 2),
+    _tileSize(tileSize),
+    _tilesX((width + tileSize - 1) / tileSize),
+    _tilesY((height + tileSize - 1) / tileSize),
+    _state((width + 2) * (height + 2), 0.0f),
+    _nextState((width + 2) * (height + 2), 0.0f),
+    _tileSums(_tilesX * _tilesY, 0.0f),
+    _tileChanged(_tilesX * _tilesY, 1),
+    _nextTileChanged(_tilesX * _tilesY, 0),
+    _activeTiles(0),
+    _boundaryMode(BoundaryTorus),
+    _boundaryValue(0.0f),
+    _ruleTable(nullptr),
+    _ruleTableLevels(0),
+    _convolution(nullptr),
+    _windowSums(width, height),
+    _pool(nullptr),
+    _blockGenerations(1),
+    _blockSize(128)
+    {
+        std::fill(_rules, _rules + 5, 0.0f);
+    }
+
+    size_t getWidth() const
+    {
+        return _width;
+    }
+
+    size_t getHeight() const
+    {
+        return _height;
+    }
+
+    size_t getCellsCount() const
+    {
+        return _width * _height;
+    }
+
+    //! Writes the interior cells to a strided target, the counterpart of load.
+    void copyState(float* target, size_t stride = 1) const
+    {
+        for (size_t x = 0; x < _width; ++x)
+        {
+            const float* row = &_state[_index(x, 0)];
+            for (size_t y = 0; y < _height; ++y)
+                target[(x * _height + y) * stride] = row[y];
+        }
+    }
+
+    //! Tiles evaluated by the last step.
+    size_t getActiveTiles() const
+    {
+        return _activeTiles;
+    }
+
+    //! What the radius 1 stencil sees past the edges, \a value is used by BoundaryFixed. Wide neighbourhoods always wrap.
+    void setBoundary(BoundaryMode mode, float value = 0.0f)
+    {
+        if (mode == _boundaryMode && value == _boundaryValue)
+            return;
+        _boundaryMode = mode;
+        _boundaryValue = value;
+        _refreshHalo(_state);
+        _refreshHalo(_nextState);
+        touch();
+    }
+
+    BoundaryMode getBoundaryMode() const
+    {
+        return _boundaryMode;
+    }
+
+    void setRules(const float* rules)
+    {
+        bool changed = false;
+        for (int i = 0; i < 5; ++i)
+        {
+            changed |= _rules[i] != rules[i];
+            _rules[i] = rules[i];
+        }
+        if (changed)
+            touch();
+    }
+
+    //! Uses table[state * (8 * (levels - 1) + 1) + sum] instead of the rules, levels 0 turns it off. The table must outlive its use.
+    void setRuleTable(uint32_t levels, const float* table)
+    {
+        if (levels != _ruleTableLevels || table != _ruleTable)
+            touch();
+        _ruleTableLevels = levels;
+        _ruleTable = table;
+    }
+
+    //! Sums neighbours through \a convolution instead of the neighbourhood, nullptr turns it off. Must outlive its use.
+    void setConvolution(ConvolutionCPU* convolution)
+    {
+        if (convolution != _convolution)
+            touch();
+        _convolution = convolution;
+        _plain.resize(getCellsCount());
+        _sums.resize(getCellsCount());
+    }
+
+    //! Square or cross of any radius, sums are rescaled to the 8 neighbours the rules are written for. Ignored while a convolution is set.
+    void setNeighbourhood(const Neighbourhood& neighbourhood)
+    {
+        if (neighbourhood != _neighbourhood)
+            touch();
+        _neighbourhood = neighbourhood;
+        _plain.resize(getCellsCount());
+        _sums.resize(getCellsCount());
+    }
+
+    //! Lets advance run up to \a generations generations per sweep over \a blockSize square tiles spread over \a pool,
+    //! which may be nullptr. Only the radius 1 stencil on a torus is blocked, anything else steps one generation at a time.
+    void setTemporalBlocking(size_t generations, ThreadPool* pool, size_t blockSize = 128)
+    {
+        _blockGenerations = std::max<size_t>(1, generations);
+        _pool = pool;
+        _blockSize = std::max<size_t>(8, blockSize);
+    }
+
+    //! Replaces the grid from a strided source, e.g. the x component of float4 cells.
+    void load(const float* source, size_t stride = 1)
+    {
+        for (size_t x = 0; x < _width; ++x)
+        {
+            for (size_t y = 0; y < _height; ++y)
+            {
+                _state[_index(x, y)] = source[(x * _height + y) * stride];
+                _nextState[_index(x, y)] = _state[_index(x, y)];
+            }
+        }
+        _refreshHalo(_state);
+        _refreshHalo(_nextState);
+        touch();
+    }
+
+    //! Marks every tile active for the next step, call after changing state or rules.
+    void touch()
+    {
+        std::fill(_tileChanged.begin(), _tileChanged.end(), 1);
+        for (size_t tx = 0; tx < _tilesX; ++tx)
+        {
+            for (size_t ty = 0; ty < _tilesY; ++ty)
+            {
+                float sum = 0.0f;
+                size_t xEnd = std::min(_width, (tx + 1) * _tileSize);
+                size_t yEnd = std::min(_height, (ty + 1) * _tileSize);
+                for (size_t x = tx * _tileSize; x < xEnd; ++x)
+                    for (size_t y = ty * _tileSize; y < yEnd; ++y)
+                        sum += _state[_index(x, y)];
+                _tileSums[tx * _tilesY + ty] = sum;
+            }
+        }
+    }
+
+    float getSum() const
+    {
+        float sum = 0.0f;
+        for (float tileSum : _tileSums)
+            sum += tileSum;
+        return sum;
+    }
+
+    //! Advances one generation, returns the sum of the new generation.
+    float step()
+    {
+        float deltaValue = cellsRuleDelta(_rules);
+        if (_convolution != nullptr || !_neighbourhood.isStencil())
+        {
+            _stepSummed(deltaValue);
+            return getSum();
+        }
+
+        _activeTiles = 0;
+        for (size_t tx = 0; tx < _tilesX; ++tx)
+        {
+            for (size_t ty = 0; ty < _tilesY; ++ty)
+            {
+                size_t tile = tx * _tilesY + ty;
+                bool changed = false;
+                // a quiet tile already holds this generation in _nextState, it equals the previous one
+                if (_isTileActive(tx, ty))
+                {
+                    _tileSums[tile] = _stepTile(tx, ty, deltaValue, changed);
+                    ++_activeTiles;
+                }
+                _nextTileChanged[tile] = changed ? 1 : 0;
+            }
+        }
+        _refreshHalo(_nextState);
+        _state.swap(_nextState);
+        _tileChanged.swap(_nextTileChanged);
+        return getSum();
+    }
+
+    //! Advances \a count generations, writing the sum of each new one to \a sums.
+    void advance(float* sums, size_t count)
+    {
+        while (count > 0)
+        {
+            size_t generations = std::min(count, _blockGenerations);
+            if (_canBlock(generations))
+            {
+                _advanceBlock(generations, sums);
+            }
+            else
+            {
+                sums[0] = step();
+                generations = 1;
+            }
+            sums += generations;
+            count -= generations;
+        }
+    }
+
+    //! Advances two copies of the grid \a generations generations under \a mode, one as advance would and one a generation
+    //! at a time. \return whether they end up identical, the grid itself is left alone. Only the torus is blocked, every
+    //! other mode advances a generation at a time either way. A standalone check, the engine never runs it.
+    bool checkTemporalBlocking(size_t generations, BoundaryMode mode) const
+    {
+        CellsCPU blocked(*this);
+        blocked.setBoundary(mode, _boundaryValue);
+        CellsCPU stepped(blocked);
+        stepped.setTemporalBlocking(1, nullptr);
+
+        std::vector<float> sums(generations);
+        blocked.advance(sums.data(), generations);
+        stepped.advance(sums.data(), generations);
+        return blocked._state == stepped._state;
+    }
+
+    //! Writes \a count samples, each the mean of a generation mapped to -1..1, advancing after each one like Cells.ncl.
+    void render(float* samples, size_t count)
+    {
+        if (count == 0)
+            return;
+
+        float scale = 2.0f / (float)getCellsCount();
+        samples[0] = getSum() * scale - 1.0f;
+        _renderSums.resize(count);
+        advance(_renderSums.data(), count);
+        for (size_t i = 1; i < count; ++i)
+            samples[i] = _renderSums[i - 1] * scale - 1.0f;
+    }
+};
+
+#endif /* CellsCPU_h */
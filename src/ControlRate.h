@@ -0,0 +1,274 @@
+//
+//  ControlRate.h
+//  GPUDSP
+//
+//  Stretches one automaton generation over several output samples.
+//
+
+#ifndef ControlRate_h
+#define ControlRate_h
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+enum ControlInterpolation
+{
+    ControlHold,        // generation value held until the next one
+    ControlLinear,      // straight line between generations, one generation of latency
+    ControlCubic,       // Catmull-Rom through the neighbouring generations, two generations of latency
+    ControlOscillators  // bank of sine oscillators whose amplitudes are cell band states, ramped between generations
+};
+
+//! Generation g sounds at sample g * interval. Ask generationsFor how many new generations a block needs, push them, then render the block.
+//! Generations and rendered frames hold getChannelsCount() interleaved values.
+class ControlRate
+{
+protected:
+    size_t                  _interval;
+    ControlInterpolation    _mode;
+    size_t                  _channelsCount;
+    uint64_t                _time;
+    uint64_t                _firstGeneration;
+
+    // rings of _capacity generations sized by the setters, render and push never allocate
+    size_t                  _blockSize;
+    size_t                  _capacity;
+    size_t                  _head;
+    size_t                  _count;
+    std::vector<float>      _values;
+
+    // oscillators mode, _bandsCount amplitudes per generation
+    size_t                  _bandsCount;
+    std::vector<float>      _bands;
+    std::vector<double>     _phases;
+    std::vector<double>     _increments;
+
+    size_t _lookahead() const
+    {
+        if (_interval == 1 || _mode == ControlHold)
+            return 0;
+        return _mode == ControlCubic ? 2 : 1;
+    }
+
+    uint64_t _generationsCount() const
+    {
+        return _firstGeneration + _count;
+    }
+
+    // generations a block can need at once, the new ones plus the one kept behind and the lookahead
+    void _reserve()
+    {
+        _capacity = (_blockSize + _interval - 1) / _interval + _lookahead() + 3;
+        _values.assign(_capacity * _channelsCount, 0.0f);
+        _bands.assign(_capacity * _bandsCount, 0.0f);
+        reset();
+    }
+
+    // ring slot of the held generation at \a offset from the first one
+    size_t _slot(size_t offset) const
+    {
+        return (_head + offset) % _capacity;
+    }
+
+    size_t _index(int64_t generation) const
+    {
+        return _slot((size_t)std::min<int64_t>(std::max<int64_t>(generation - (int64_t)_firstGeneration, 0), (int64_t)_count - 1));
+    }
+
+    float _value(int64_t generation, size_t channel) const
+    {
+        return _values[_index(generation) * _channelsCount + channel];
+    }
+
+    float _band(int64_t generation, size_t band) const
+    {
+        return _bands[_index(generation) * _bandsCount + band];
+    }
+
+    // drops the first held generation
+    void _popFront()
+    {
+        _head = _slot(1);
+        --_count;
+        ++_firstGeneration;
+    }
+
+    float _interpolate(int64_t generation, size_t channel, float fraction) const
+    {
+        float current = _value(generation, channel);
+        if (_mode == ControlLinear)
+            return current + (_value(generation + 1, channel) - current) * fraction;
+
+        // Catmull-Rom
+        float previous = _value(generation - 1, channel);
+        float next = _value(generation + 1, channel);
+        float afterNext = _value(generation + 2, channel);
+        float a = -0.5f * previous + 1.5f * current - 1.5f * next + 0.5f * afterNext;
+        float b = previous - 2.5f * current + 2.0f * next - 0.5f * afterNext;
+        float c = -0.5f * previous + 0.5f * next;
+        return ((a * fraction + b) * fraction + c) * fraction + current;
+    }
+
+    float _oscillators(int64_t generation, float fraction)
+    {
+        float sum = 0.0f;
+        for (size_t band = 0; band < _bandsCount; ++band)
+        {
+            float amplitude = _band(generation, band);
+            amplitude += (_band(generation + 1, band) - amplitude) * fraction;
+            sum += amplitude * (float)sin(_phases[band]);
+            _phases[band] += _increments[band];
+            if (_phases[band] > 2.0 * M_PI)
+                _phases[band] -= 2.0 * M_PI;
+        }
+        return sum / (float)_bandsCount;
+    }
+
+public:
+    ControlRate() : _interval(1), _mode(ControlHold), _channelsCount(1), _blockSize(1), _bandsCount(0)
+    {
+        _reserve();
+    }
+
+    //! Most frames rendered at once, sizes the generation rings.
+    void setBlockSize(size_t blockSize)
+    {
+        _blockSize = std::max<size_t>(1, blockSize);
+        _reserve();
+    }
+
+    //! Values per generation and per rendered frame. Oscillators are mono and sound the same on every channel.
+    void setChannels(size_t channelsCount)
+    {
+        _channelsCount = std::max<size_t>(1, channelsCount);
+        _reserve();
+    }
+
+    size_t getChannelsCount() const
+    {
+        return _channelsCount;
+    }
+
+    //! One generation every \a interval samples.
+    void setInterval(size_t interval, ControlInterpolation mode)
+    {
+        _interval = std::max<size_t>(1, interval);
+        _mode = mode;
+        _reserve();
+    }
+
+    size_t getInterval() const
+    {
+        return _interval;
+    }
+
+    ControlInterpolation getMode() const
+    {
+        return _mode;
+    }
+
+    //! Oscillator frequencies spread exponentially from \a lowest over \a octaves, one per band.
+    void setBands(size_t bandsCount, float sampleRate, float lowest = 55.0f, float octaves = 5.0f)
+    {
+        _bandsCount = bandsCount;
+        _phases.assign(bandsCount, 0.0);
+        _increments.resize(bandsCount);
+        for (size_t band = 0; band < bandsCount; ++band)
+        {
+            double frequency = lowest * pow(2.0, octaves * (double)band / (double)std::max<size_t>(1, bandsCount - 1));
+            _increments[band] = 2.0 * M_PI * frequency / sampleRate;
+        }
+        _reserve();
+    }
+
+    size_t getBandsCount() const
+    {
+        return _bandsCount;
+    }
+
+    //! `true` while every sample is its own generation and rendering is a plain copy.
+    bool isPassthrough() const
+    {
+        return _interval == 1 && _mode != ControlOscillators;
+    }
+
+    bool needsBands() const
+    {
+        return _mode == ControlOscillators;
+    }
+
+    void reset()
+    {
+        _time = 0;
+        _firstGeneration = 0;
+        _head = 0;
+        _count = 0;
+    }
+
+    //! New generations needed before \a count more samples can be rendered.
+    size_t generationsFor(size_t count) const
+    {
+        uint64_t last = (_time + count - 1) / _interval + _lookahead();
+        return last + 1 > _generationsCount() ? (size_t)(last + 1 - _generationsCount()) : 0;
+    }
+
+    //! Appends \a count generations of getChannelsCount() values and, in oscillators mode, getBandsCount() amplitudes for each or nullptr to hold the last ones.
+    //! Blocks up to setBlockSize() frames never need more than the rings hold, past that the oldest generations are dropped.
+    void push(const float* values, size_t count, const float* bands = nullptr)
+    {
+        for (size_t g = 0; g < count; ++g)
+        {
+            if (_count == _capacity)
+                _popFront();
+            size_t slot = _slot(_count);
+            std::copy(values + g * _channelsCount, values + (g + 1) * _channelsCount, _values.begin() + slot * _channelsCount);
+            if (needsBands())
+            {
+                // generations without band states keep the last known ones
+                float* target = &_bands[slot * _bandsCount];
+                if (bands != nullptr)
+                    std::copy(bands + g * _bandsCount, bands + (g + 1) * _bandsCount, target);
+                else if (_count > 0)
+                    std::copy_n(&_bands[_slot(_count - 1) * _bandsCount], _bandsCount, target);
+                else
+                    std::fill(target, target + _bandsCount, 0.0f);
+            }
+            ++_count;
+        }
+    }
+
+    //! Writes \a count frames.
+    void render(float* target, size_t count)
+    {
+        if (_count == 0)
+        {
+            std::fill(target, target + count * _channelsCount, 0.0f);
+            return;
+        }
+
+        for (size_t i = 0; i < count; ++i, ++_time)
+        {
+            int64_t generation = (int64_t)(_time / _interval);
+            float fraction = (float)(_time % _interval) / (float)_interval;
+            float* frame = target + i * _channelsCount;
+            if (_mode == ControlOscillators)
+                std::fill(frame, frame + _channelsCount, _oscillators(generation, fraction));
+            else if (_mode == ControlHold || _interval == 1)
+                for (size_t channel = 0; channel < _channelsCount; ++channel)
+                    frame[channel] = _value(generation, channel);
+            else
+                for (size_t channel = 0; channel < _channelsCount; ++channel)
+                    frame[channel] = _interpolate(generation, channel, fraction);
+        }
+
+        // keep one generation behind the current one for the cubic
+        uint64_t keepFrom = _time / _interval;
+        keepFrom = keepFrom > 0 ? keepFrom - 1 : 0;
+        while (_firstGeneration < keepFrom && _count > 1)
+            _popFront();
+    }
+};
+
+#endif /* ControlRate_h */
@@ -0,0 +1,248 @@
+//
+//  Convolution.h
+//  GPUDSP
+//
+//  Radial neighbourhood kernels summed by FFT convolution over the torus.
+//
+
+#ifndef Convolution_h
+#define Convolution_h
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstdint>
+#include <vector>
+
+//! Radial weight profile of a Lenia-style neighbourhood, the distance is measured in units of \a radius.
+struct ConvolutionKernel
+{
+    enum Shape
+    {
+        ShapeRing,          // exponential bump exp(4 - 1 / (r * (1 - r))) peaking at half the radius
+        ShapeGaussianShell  // exp(-(r - peak)^2 / (2 * width^2)), cut at the radius
+    };
+
+    Shape   shape;
+    float   radius;
+    float   peak;
+    float   width;
+
+    ConvolutionKernel(Shape initShape = ShapeRing, float initRadius = 8.0f, float initPeak = 0.5f, float initWidth = 0.15f) :
+    shape(initShape), radius(initRadius), peak(initPeak), width(initWidth) {}
+
+    float weight(float distance) const
+    {
+        float r = distance / radius;
+        if (r <= 0.0f || r >= 1.0f)
+            return 0.0f;
+
+        if (shape == ShapeRing)
+            return expf(4.0f - 1.0f / (r * (1.0f - r)));
+        return expf(-(r - peak) * (r - peak) / (2.0f * width * width));
+    }
+
+    bool operator==(const ConvolutionKernel& other) const
+    {
+        return shape == other.shape && radius == other.radius && peak == other.peak && width == other.width;
+    }
+
+    bool operator!=(const ConvolutionKernel& other) const
+    {
+        return !(*this == other);
+    }
+};
+
+//! Radix-2 complex FFT over a power of two grid, (x, y) at x * height + y.
+class FFT2D
+{
+protected:
+    typedef std::complex<float> Complex;
+
+    size_t                  _width;
+    size_t                  _height;
+    std::vector<Complex>    _twiddlesX;
+    std::vector<Complex>    _twiddlesY;
+    std::vector<uint32_t>   _reverseX;
+    std::vector<uint32_t>   _reverseY;
+    std::vector<Complex>    _line;
+
+    static void _prepareAxis(size_t n, std::vector<Complex>& twiddles, std::vector<uint32_t>& reverse)
+    {
+        twiddles.resize(n / 2);
+        for (size_t k = 0; k < n / 2; ++k)
+            twiddles[k] = std::polar(1.0f, (float)(-2.0 * M_PI * (double)k / (double)n));
+
+        reverse.resize(n);
+        uint32_t bits = 0;
+        while (((size_t)1 << bits) < n)
+            ++bits;
+        for (uint32_t i = 0; i < n; ++i)
+        {
+            uint32_t r = 0;
+            for (uint32_t b = 0; b < bits; ++b)
+                r |= ((i >> b) & 1) << (bits - 1 - b);
+            reverse[i] = r;
+        }
+    }
+
+    static void _transform(Complex* data, size_t n, const std::vector<Complex>& twiddles, const std::vector<uint32_t>& reverse, bool inverse)
+    {
+        for (size_t i = 0; i < n; ++i)
+        {
+            if (i < reverse[i])
+                std::swap(data[i], data[reverse[i]]);
+        }
+
+        for (size_t length = 2; length <= n; length <<= 1)
+        {
+            size_t half = length / 2;
+            size_t step = n / length;
+            for (size_t start = 0; start < n; start += length)
+            {
+                for (size_t k = 0; k < half; ++k)
+                {
+                    Complex w = inverse ? std::conj(twiddles[k * step]) : twiddles[k * step];
+                    Complex u = data[start + k];
+                    Complex v = data[start + k + half] * w;
+                    data[start + k] = u + v;
+                    data[start + k + half] = u - v;
+                }
+            }
+        }
+    }
+
+public:
+    FFT2D(size_t width, size_t height) : _width(width), _height(height), _line(width)
+    {
+        _prepareAxis(width, _twiddlesX, _reverseX);
+        _prepareAxis(height, _twiddlesY, _reverseY);
+    }
+
+    static bool supportsSize(size_t width, size_t height)
+    {
+        return width >= 2 && height >= 2 && (width & (width - 1)) == 0 && (height & (height - 1)) == 0;
+    }
+
+    //! In place, the inverse is not normalized.
+    void transform(Complex* data, bool inverse)
+    {
+        for (size_t x = 0; x < _width; ++x)
+            _transform(data + x * _height, _height, _twiddlesY, _reverseY, inverse);
+
+        // columns are strided, gather them into a contiguous line
+        for (size_t y = 0; y < _height; ++y)
+        {
+            for (size_t x = 0; x < _width; ++x)
+                _line[x] = data[x * _height + y];
+            _transform(_line.data(), _width, _twiddlesX, _reverseX, inverse);
+            for (size_t x = 0; x < _width; ++x)
+                data[x * _height + y] = _line[x];
+        }
+    }
+};
+
+//! Toroidal neighbour sums of a float grid through a cached kernel spectrum.
+class ConvolutionCPU
+{
+protected:
+    typedef std::complex<float> Complex;
+
+    size_t                  _width;
+    size_t                  _height;
+    FFT2D                   _fft;
+    ConvolutionKernel       _kernel;
+    float                   _scale;
+    bool                    _hasKernel;
+    std::vector<Complex>    _spectrum;
+    std::vector<Complex>    _buffer;
+
+public:
+    ConvolutionCPU(size_t width, size_t height) :
+    _width(width),
+    _height(height),
+    _fft(width, height),
+    _scale(0.0f),
+    _hasKernel(false),
+    _spectrum(width * height),
+    _buffer(width * height)
+    {
+    }
+
+    static bool supportsSize(size_t width, size_t height)
+    {
+        return FFT2D::supportsSize(width, height);
+    }
+
+    size_t getWidth() const
+    {
+        return _width;
+    }
+
+    size_t getHeight() const
+    {
+        return _height;
+    }
+
+    //! Spectrum of the kernel with the inverse FFT normalization folded in, \a scale is what a fully alive neighbourhood sums to.
+    //! Radius is clamped below half the grid. \return `true` if the spectrum was rebuilt.
+    bool setKernel(const ConvolutionKernel& kernel, float scale)
+    {
+        if (_hasKernel && kernel == _kernel && scale == _scale)
+            return false;
+
+        _kernel = kernel;
+        _kernel.radius = std::max(1.0f, std::min(kernel.radius, (float)(std::min(_width, _height) / 2) - 1.0f));
+        _scale = scale;
+        _hasKernel = true;
+
+        std::fill(_spectrum.begin(), _spectrum.end(), Complex(0.0f, 0.0f));
+        int reach = (int)ceilf(_kernel.radius);
+        float total = 0.0f;
+        for (int dx = -reach; dx <= reach; ++dx)
+        {
+            for (int dy = -reach; dy <= reach; ++dy)
+            {
+                float weight = _kernel.weight(sqrtf((float)(dx * dx + dy * dy)));
+                size_t x = (dx + _width) % _width;
+                size_t y = (dy + _height) % _height;
+                _spectrum[x * _height + y] += weight;
+                total += weight;
+            }
+        }
+
+        float normalization = total > 0.0f ? scale / (total * (float)(_width * _height)) : 0.0f;
+        for (Complex& value : _spectrum)
+            value *= normalization;
+        _fft.transform(_spectrum.data(), false);
+        return true;
+    }
+
+    const ConvolutionKernel& getKernel() const
+    {
+        return _kernel;
+    }
+
+    //! Interleaved real / imaginary spectrum, \a width * \a height complex values.
+    const float* getSpectrum() const
+    {
+        return (const float*)_spectrum.data();
+    }
+
+    //! Writes the weighted neighbour sum of every cell, reading \a source with \a stride like CellsCPU::load.
+    void convolve(const float* source, float* sums, size_t stride = 1)
+    {
+        for (size_t i = 0; i < _buffer.size(); ++i)
+            _buffer[i] = Complex(source[i * stride], 0.0f);
+
+        _fft.transform(_buffer.data(), false);
+        for (size_t i = 0; i < _buffer.size(); ++i)
+            _buffer[i] *= _spectrum[i];
+        _fft.transform(_buffer.data(), true);
+
+        for (size_t i = 0; i < _buffer.size(); ++i)
+            sums[i] = _buffer[i].real();
+    }
+};
+
+#endif /* Convolution_h */
@@ -0,0 +1,152 @@
+//
+//  CycleDetector.h
+//  GPUDSP
+//
+//  Spots repeating generations and replays the output period they produce.
+//
+
+#ifndef CycleDetector_h
+#define CycleDetector_h
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+class CycleDetector
+{
+protected:
+    size_t                                  _stateLength;
+    size_t                                  _maxPeriod;
+    uint64_t                                _generation;
+
+    // last _maxPeriod generations, slot = generation % _maxPeriod
+    std::vector<uint8_t>                    _states;
+    std::vector<uint64_t>                   _hashes;
+    std::vector<float>                      _samples;
+    std::unordered_map<uint64_t, uint64_t>  _seen;
+
+    bool                                    _locked;
+    uint64_t                                _cycleStart;
+    size_t                                  _period;
+    size_t                                  _phase;
+
+    uint8_t* _state(uint64_t generation)
+    {
+        return &_states[(generation % _maxPeriod) * _stateLength];
+    }
+
+public:
+    //! Keeps at most \a memoryBudget bytes of past states, which bounds the longest period it can find.
+    CycleDetector(size_t stateLength, size_t memoryBudget = 16 << 20, size_t maxPeriod = 4096) :
+    _stateLength(stateLength)
+    {
+        _maxPeriod = std::max<size_t>(1, std::min(maxPeriod, memoryBudget / std::max<size_t>(1, stateLength)));
+        _states.resize(_maxPeriod * _stateLength);
+        _hashes.resize(_maxPeriod);
+        _samples.resize(_maxPeriod);
+        reset();
+    }
+
+    //! FNV-1a style hash over \a length bytes, taken a 64-bit word at a time.
+    static uint64_t hash(const void* data, size_t length)
+    {
+        const uint8_t* bytes = (const uint8_t*)data;
+        uint64_t result = 0xcbf29ce484222325ull;
+        size_t words = length / sizeof(uint64_t);
+        for (size_t i = 0; i < words; ++i)
+        {
+            uint64_t word;
+            std::memcpy(&word, bytes + i * sizeof(uint64_t), sizeof(uint64_t));
+            result ^= word;
+            result *= 0x100000001b3ull;
+            result ^= result >> 32;
+        }
+        for (size_t i = words * sizeof(uint64_t); i < length; ++i)
+        {
+            result ^= bytes[i];
+            result *= 0x100000001b3ull;
+        }
+        return result;
+    }
+
+    //! Forgets all generations and leaves replay, call on edits and rule changes.
+    void reset()
+    {
+        _seen.clear();
+        _generation = 0;
+        _locked = false;
+        _period = 0;
+        _phase = 0;
+    }
+
+    //! Records one generation and the sample it produced. \return `true` once a repeat was found.
+    bool push(const void* state, float sample)
+    {
+        if (_locked)
+        {
+            _phase = (_phase + 1) % _period;
+            return true;
+        }
+
+        uint64_t stateHash = hash(state, _stateLength);
+        auto found = _seen.find(stateHash);
+        if (found != _seen.end() && std::memcmp(_state(found->second), state, _stateLength) == 0)
+        {
+            _locked = true;
+            _cycleStart = found->second;
+            _period = (size_t)(_generation - found->second);
+            _phase = 1 % _period;
+            return true;
+        }
+
+        if (_generation >= _maxPeriod)
+        {
+            uint64_t evicted = _generation - _maxPeriod;
+            auto old = _seen.find(_hashes[evicted % _maxPeriod]);
+            if (old != _seen.end() && old->second == evicted)
+                _seen.erase(old);
+        }
+
+        std::memcpy(_state(_generation), state, _stateLength);
+        _hashes[_generation % _maxPeriod] = stateHash;
+        _samples[_generation % _maxPeriod] = sample;
+        _seen[stateHash] = _generation;
+        ++_generation;
+        return false;
+    }
+
+    bool isLocked() const
+    {
+        return _locked;
+    }
+
+    size_t getPeriod() const
+    {
+        return _period;
+    }
+
+    size_t getMaxPeriod() const
+    {
+        return _maxPeriod;
+    }
+
+    //! Writes the next \a count samples of the cached period.
+    void replay(float* target, size_t count)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            target[i] = _samples[(_cycleStart + _phase) % _maxPeriod];
+            _phase = (_phase + 1) % _period;
+        }
+    }
+
+    //! State the replay has reached, the generation the next replayed sample belongs to.
+    const void* getReplayState()
+    {
+        return _state(_cycleStart + _phase);
+    }
+};
+
+#endif /* CycleDetector_h */
@@ -0,0 +1,202 @@
+//
+//  DSPCPU.h
+//  GPUDSP
+//
+//  Continuous automaton engine without a GPU, the fallback when neither OpenCL nor OpenGL is there.
+//
+
+#ifndef DSPCPU_h
+#define DSPCPU_h
+
+#include "DSPEngine.h"
+#include "CellsCPU.h"
+#include "Philox.h"
+#include <chrono>
+
+//! CellsCPU stepping a radius 1 toroidal grid, one generation per sample, the mean of each generation on every channel.
+class DSPCPU : public DSPEngine
+{
+protected:
+    CellsCPU            cellsCPU;
+    DSPSampleType4*     cells;
+    size_t              cellsCount;
+    glm::ivec2          gridSize;
+    float               rules[5];
+
+    uint64_t            seed;
+    uint64_t            pendingSeed;
+    bool                isSeedDirty;
+
+    std::vector<DSPSampleType> mono;
+    std::vector<DSPSampleType> samples;
+    size_t              channelsCount;
+    size_t              bufferSize;
+    size_t              samplesProcessed;
+    bool                isPaused;
+
+    void _applySeed()
+    {
+        if (!isSeedDirty)
+            return;
+
+        seed = pendingSeed;
+        isSeedDirty = false;
+        for (size_t i = 0; i < cellsCount; ++i)
+            cells[i].s[0] = philoxCellUniform(seed, (uint32_t)i);
+        cellsCPU.load(&cells[0].s[0], 4);
+    }
+
+    void _applyDefferedUpdateGrid()
+    {
+        bool edited = false;
+        for (size_t i = 0; i < cellsCount; ++i)
+        {
+            float replaceMask = DefferedUpdateGrid[i].s[0] > 0.0f ? 1.0f : 0.0f;
+            float clearMask = DefferedUpdateGrid[i].s[0] < 0.0f ? 1.0f : 0.0f;
+            edited |= replaceMask + clearMask > 0.0f;
+            for (int j = 0; j < 4; ++j)
+            {
+                cells[i].s[j] = (replaceMask * DefferedUpdateGrid[i].s[j] + (1.0f - replaceMask) * cells[i].s[j]) * (1.0f - clearMask);
+                DefferedUpdateGrid[i].s[j] = 0.0f;
+            }
+        }
+        if (edited)
+            cellsCPU.load(&cells[0].s[0], 4);
+    }
+
+    // mono generations fanned out to interleaved frames
+    void _readSamples(size_t offset, size_t count, DSPSampleType* target)
+    {
+        for (size_t frame = 0; frame < count; ++frame)
+            for (size_t channel = 0; channel < channelsCount; ++channel)
+                target[frame * channelsCount + channel] = mono[offset + frame];
+    }
+
+public:
+    DSPCPU(size_t /* initSampleRate */, size_t initBufferSize, glm::ivec2 initGridSize = glm::ivec2(16, 16), size_t initChannelsCount = 1, uint64_t initSeed = 0) :
+    DSPEngine(initBufferSize, std::max<size_t>(1, initChannelsCount)),
+    cellsCPU(initGridSize.x, initGridSize.y)
+    {
+        this->gridSize = initGridSize;
+        this->cellsCount = (size_t)initGridSize.x * initGridSize.y;
+        this->channelsCount = std::max<size_t>(1, initChannelsCount);
+        this->bufferSize = initBufferSize;
+        this->samplesProcessed = 0;
+        this->isPaused = false;
+        this->mono.resize(bufferSize);
+        this->samples.resize(bufferSize * channelsCount);
+
+        // the DSPOpenCL defaults, so switching backends keeps the sound
+        rules[0] = 1.89f;
+        rules[1] = 0.35f;
+        rules[2] = 1.89f;
+        rules[3] = 0.36f;
+        rules[4] = 0.0625f;
+
+        cells = new DSPSampleType4[cellsCount]();
+        DefferedUpdateGrid = new DSPSampleType4[cellsCount]();
+        pendingSeed = initSeed != 0 ? initSeed : (uint64_t)std::chrono::high_resolution_clock::now().time_since_epoch().count();
+        isSeedDirty = true;
+        _applySeed();
+        _prepareGridSnapshots();
+    }
+
+    ~DSPCPU()
+    {
+        delete [] cells;
+        delete [] DefferedUpdateGrid;
+    }
+
+    DSPBackend getBackend()
+    {
+        return DSPBackendCPU;
+    }
+
+    bool pause()
+    {
+        isPaused = !isPaused;
+        return isPaused;
+    }
+
+    size_t getChannelsCount()
+    {
+        return channelsCount;
+    }
+
+    glm::ivec2 getGridSize()
+    {
+        return gridSize;
+    }
+
+    size_t getCellsCount()
+    {
+        return cellsCount;
+    }
+
+    DSPSampleType4* getCurrentGridState()
+    {
+        return cells;
+    }
+
+    float* getRulesBirthCenter()
+    {
+        return &rules[0];
+    }
+    float* rulesBirthRadius()
+    {
+        return &rules[1];
+    }
+    float* rulesKeepCenter()
+    {
+        return &rules[2];
+    }
+    float* rulesKeepRadius()
+    {
+        return &rules[3];
+    }
+    float* rulesSpeed()
+    {
+        return &rules[4];
+    }
+
+    void reseed(uint64_t newSeed)
+    {
+        pendingSeed = newSeed;
+        isSeedDirty = true;
+    }
+
+    uint64_t getSeed()
+    {
+        return isSeedDirty ? pendingSeed : seed;
+    }
+
+    void generateSamples(float* data = NULL)
+    {
+        if (isPaused)
+            return;
+
+        size_t toWrite = _getFramesToWrite();
+        if (toWrite <= 0)
+            return;
+
+        _applySeed();
+        _applyDefferedUpdateGrid();
+        cellsCPU.setRules(rules);
+        cellsCPU.render(mono.data(), toWrite);
+        cellsCPU.copyState(&cells[0].s[0], 4);
+
+        if (data != NULL)
+        {
+            _readSamples(0, toWrite, data);
+            _shareBlock(data, toWrite);
+            samplesProcessed += toWrite;
+        }
+        else
+        {
+            samplesProcessed += _writeRing(toWrite, channelsCount, samples.data(), [this](size_t offset, size_t count, DSPSampleType* target) { _readSamples(offset, count, target); });
+        }
+        _publishGridSnapshot(toWrite);
+    }
+};
+
+#endif /* DSPCPU_h */
@@ -0,0 +1,342 @@
+//
+//  DSPEngine.h
+//  GPUDSP
+//
+//  Backend independent engine interface, the OpenCL, OpenGL and CPU engines are picked at runtime, see DSPEngines.h.
+//
+
+#ifndef DSPEngine_h
+#define DSPEngine_h
+
+#include "cinder/app/cocoa/PlatformCocoa.h"
+#include "BroadcastRingBuffer.h"
+#include "TripleBuffer.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+typedef float           DSPSampleType;
+
+//! State, frequency and two spare lanes of a cell, laid out like cl_float4 so cells go to the device as they are.
+struct alignas(16) DSPSampleType4
+{
+    DSPSampleType       s[4];
+};
+
+// the audio callback is reader 0, recorders and meters add lossy readers of their own
+typedef BroadcastRingBufferT<DSPSampleType> RingBuffer;
+
+enum DSPBackend
+{
+    DSPBackendOpenCL,   // DSPOpenCL, any CellsMode
+    DSPBackendOpenGL,   // DSPOpenGL, transform feedback oscillator bank
+    DSPBackendCPU,      // DSPCPU, continuous cells stepped by CellsCPU
+    DSPBackendVoices    // DSPVoices, many small continuous grids stepped and mixed by one launch
+};
+
+// how a finished block reaches the ring buffer
+enum DSPRingMode
+{
+    DSPRingDirect,      // read back straight into the free space of the ring
+    DSPRingStaged       // read back into a block of the engine, then copied in with write()
+};
+
+// who calls generateSamples
+enum DSPBlockMode
+{
+    DSPBlockRing,       // a processing thread keeps the ring full, the audio callback only reads from it
+    DSPBlockFixed,      // the audio callback renders bufferSize frames into its own buffer
+    DSPBlockDirect      // a DirectRenderer worker renders bufferSize frames one block ahead of the audio callback
+};
+
+inline const char* getDSPBackendName(DSPBackend backend)
+{
+    switch (backend)
+    {
+        case DSPBackendOpenCL: return "OpenCL";
+        case DSPBackendOpenGL: return "OpenGL";
+        case DSPBackendCPU: return "CPU";
+        case DSPBackendVoices: return "Voices";
+    }
+    return "Unknown";
+}
+
+//! Ring buffer and block bookkeeping shared by everything that renders interleaved frames for the audio callback.
+class DSPOutput
+{
+protected:
+    DSPRingMode         ringMode;
+    DSPBlockMode        blockMode;
+    size_t              ringFrames;
+    size_t              ringChannels;
+    size_t              fillFrames;
+    size_t              blockFrames;
+    std::atomic<size_t> underrunsCount;
+    std::atomic<size_t> shortfallFrames;
+
+    // readRing concealment, only touched on the read thread
+    std::vector<DSPSampleType> lastFrame;
+    float               concealGain;
+    size_t              concealFrames;
+
+    //! Frames the next block has to render, all of the ring in fixed and direct block mode, otherwise what tops the queued frames up
+    //! to the fill level, or the whole free space if there is none.
+    size_t _getFramesToWrite()
+    {
+        if (blockMode != DSPBlockRing)
+        {
+            blockFrames = ringFrames;
+            return blockFrames;
+        }
+        
+        size_t freeFrames = RingBuffer.getAvailableWrite() / ringChannels;
+        size_t queuedFrames = ringFrames - freeFrames;
+        blockFrames = fillFrames == 0 ? freeFrames : std::min(freeFrames, fillFrames - std::min(fillFrames, queuedFrames));
+        return blockFrames;
+    }
+
+    //! Copies a block rendered into the caller's buffer to the ring as well, if anyone besides the audio callback reads it.
+    void _shareBlock(const DSPSampleType* data, size_t frames)
+    {
+        if (RingBuffer.getExtraReadersCount() > 0)
+            RingBuffer.write(data, std::min(frames * ringChannels, RingBuffer.getAvailableWrite()) / ringChannels * ringChannels);
+    }
+
+    //! Moves \a frames finished frames into the ring, \a read(offset, count, target) copies frames of the block in the order they were rendered.
+    //! \a staging holds a whole block in staged mode. \return frames written.
+    template <typename Reader>
+    size_t _writeRing(size_t frames, size_t channelsCount, DSPSampleType* staging, Reader read)
+    {
+        DSPSampleType* firstPart = nullptr;
+        DSPSampleType* secondPart = nullptr;
+        size_t firstLength = 0;
+        size_t secondLength = 0;
+
+        if (ringMode == DSPRingDirect)
+            RingBuffer.getUnsafeDataWritePointer(frames * channelsCount, firstPart, secondPart, firstLength, secondLength);
+        // the ring holds whole frames, so a wrap never splits one
+        if (firstPart == nullptr)
+        {
+            read(0, frames, staging);
+            return RingBuffer.write(staging, frames * channelsCount) ? frames : 0;
+        }
+
+        read(0, firstLength / channelsCount, firstPart);
+        if (secondPart != nullptr)
+            read(firstLength / channelsCount, secondLength / channelsCount, secondPart);
+        RingBuffer.commitUnsafeDataWrite(frames * channelsCount);
+        return frames;
+    }
+
+public:
+    RingBuffer RingBuffer;
+
+    //! A ring of \a frames interleaved frames of \a channels samples, also the block length of fixed block mode.
+    DSPOutput(size_t frames, size_t channels) :
+    RingBuffer(frames * channels, channels)
+    {
+        ringMode = DSPRingDirect;
+        blockMode = DSPBlockRing;
+        ringFrames = frames;
+        ringChannels = channels;
+        fillFrames = 0;
+        blockFrames = 0;
+        underrunsCount = 0;
+        shortfallFrames = 0;
+        lastFrame.assign(channels, 0.0f);
+        concealGain = 1.0f;
+        concealFrames = 64;
+    }
+
+    virtual ~DSPOutput() {}
+
+    void setRingMode(DSPRingMode mode)
+    {
+        ringMode = mode;
+    }
+
+    DSPRingMode getRingMode()
+    {
+        return ringMode;
+    }
+
+    //! In fixed and direct block mode the caller passes its buffer to generateSamples, the ring only carries the blocks
+    //! for extra readers, and reader 0, which nobody reads then, stops holding the writer back.
+    void setBlockMode(DSPBlockMode mode)
+    {
+        blockMode = mode;
+        RingBuffer.setReaderMode(0, mode == DSPBlockRing ? RingReaderLossless : RingReaderLossy);
+    }
+
+    DSPBlockMode getBlockMode()
+    {
+        return blockMode;
+    }
+
+    //! Frames the ring is kept filled to, which is the output latency. 0 fills all of it.
+    void setRingFill(size_t frames)
+    {
+        fillFrames = std::min(frames, ringFrames);
+    }
+
+    size_t getRingFill()
+    {
+        return fillFrames == 0 ? ringFrames : fillFrames;
+    }
+
+    size_t getRingFrames()
+    {
+        return ringFrames;
+    }
+
+    //! Frames the last generateSamples call set out to render.
+    size_t getBlockFrames()
+    {
+        return blockFrames;
+    }
+
+    //! Reads \a count samples for the audio callback, as many whole frames as the ring has. The missing ones hold the last
+    //! frame played, fading out, and the first frames after them fade back in. \return false if frames were missing.
+    //! Only safe on the read thread.
+    bool readRing(DSPSampleType* data, size_t count)
+    {
+        size_t frames = count / ringChannels;
+        size_t readFrames = std::min(frames, RingBuffer.getAvailableRead() / ringChannels);
+        RingBuffer.read(data, readFrames * ringChannels);
+
+        float step = 1.0f / (float)concealFrames;
+        for (size_t frame = 0; frame < readFrames && concealGain < 1.0f; ++frame)
+        {
+            // crossfade from the held frame into the ring
+            concealGain = std::min(1.0f, concealGain + step);
+            for (size_t channel = 0; channel < ringChannels; ++channel)
+            {
+                DSPSampleType& sample = data[frame * ringChannels + channel];
+                sample = sample * concealGain + lastFrame[channel] * (1.0f - concealGain);
+            }
+        }
+        if (readFrames > 0)
+            std::copy(&data[(readFrames - 1) * ringChannels], &data[readFrames * ringChannels], lastFrame.begin());
+
+        if (readFrames == frames)
+            return true;
+
+        // lastFrame is the last frame played, the fade out starts from it and leaves it where the fade stopped
+        float hold = 1.0f;
+        for (size_t frame = readFrames; frame < frames; ++frame)
+        {
+            hold = std::max(0.0f, hold - step);
+            for (size_t channel = 0; channel < ringChannels; ++channel)
+                data[frame * ringChannels + channel] = lastFrame[channel] * hold;
+        }
+        for (size_t channel = 0; channel < ringChannels; ++channel)
+            lastFrame[channel] *= hold;
+        concealGain = 0.0f;
+
+        ++underrunsCount;
+        shortfallFrames += frames - readFrames;
+        return false;
+    }
+
+    size_t getUnderrunsCount()
+    {
+        return underrunsCount;
+    }
+
+    //! Frames readRing had to conceal so far, the refill has to grow by at least what this grows by.
+    size_t getShortfallFrames()
+    {
+        return shortfallFrames;
+    }
+};
+
+//! What the app and the audio node need from an engine. Backend specific controls stay on the backend classes.
+class DSPEngine : public DSPOutput
+{
+protected:
+    TripleBufferT<DSPSampleType4> gridSnapshots;
+    size_t              snapshotInterval;
+    size_t              snapshotFrames;
+
+    //! Sizes the snapshots to the grid and publishes the grid as it is, for constructors once the cells are there.
+    void _prepareGridSnapshots()
+    {
+        gridSnapshots.resize(getCellsCount());
+        snapshotFrames = snapshotInterval;
+        _publishGridSnapshot(0);
+    }
+
+    //! Copies the grid out for the visualizer once \a frames more rendered frames add up to the snapshot interval.
+    //! Called on whatever thread runs generateSamples.
+    void _publishGridSnapshot(size_t frames)
+    {
+        snapshotFrames += frames;
+        if (snapshotFrames < snapshotInterval)
+            return;
+        snapshotFrames = 0;
+        const DSPSampleType4* grid = getCurrentGridState();
+        std::copy(grid, grid + gridSnapshots.getSize(), gridSnapshots.getWriteBuffer());
+        gridSnapshots.publish();
+    }
+
+public:
+    //! Edits applied at the start of the next block, .s[0] > 0 replaces a cell with the entry, < 0 clears it.
+    DSPSampleType4*     DefferedUpdateGrid;
+
+    DSPEngine(size_t frames, size_t channels) :
+    DSPOutput(frames, channels)
+    {
+        DefferedUpdateGrid = NULL;
+        snapshotInterval = 0;
+        snapshotFrames = 0;
+    }
+
+    virtual DSPBackend getBackend() = 0;
+
+    //! Tops the ring up to its fill level, or renders a block of interleaved frames into \a data in fixed block mode.
+    virtual void generateSamples(float* data = NULL) = 0;
+    //! Toggles pausing, \return whether the engine is paused now.
+    virtual bool pause() = 0;
+
+    virtual size_t getChannelsCount() = 0;
+    virtual glm::ivec2 getGridSize() = 0;
+    virtual size_t getCellsCount() = 0;
+    virtual DSPSampleType4* getCurrentGridState() = 0;
+
+    virtual float* getRulesBirthCenter() = 0;
+    virtual float* rulesBirthRadius() = 0;
+    virtual float* rulesKeepCenter() = 0;
+    virtual float* rulesKeepRadius() = 0;
+    virtual float* rulesSpeed() = 0;
+
+    //! Replaces every cell state with philoxCellUniform values keyed by \a newSeed at the next block.
+    virtual void reseed(uint64_t newSeed) = 0;
+    virtual uint64_t getSeed() = 0;
+
+    //! Rendered frames between two grid snapshots, 0 publishes one after every block.
+    void setSnapshotInterval(size_t frames)
+    {
+        snapshotInterval = frames;
+    }
+
+    size_t getSnapshotInterval()
+    {
+        return snapshotInterval;
+    }
+
+    //! Picks up the latest grid snapshot, \return whether getGridSnapshot changed. Never waits for the engine.
+    //! Only safe on one reader thread.
+    bool updateGridSnapshot()
+    {
+        return gridSnapshots.update();
+    }
+
+    //! getCellsCount cells as of the snapshot updateGridSnapshot picked up last.
+    const DSPSampleType4* getGridSnapshot()
+    {
+        return gridSnapshots.getReadBuffer();
+    }
+};
+
+#endif /* DSPEngine_h */
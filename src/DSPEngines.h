@@ -0,0 +1,122 @@
+//
+//  DSPEngines.h
+//  GPUDSP
+//
+//  Runtime backend selection, falls back to the CPU engine when the asked for device is missing.
+//
+
+#ifndef DSPEngines_h
+#define DSPEngines_h
+
+#include "DSPOpenCL.h"
+#include "CLDeviceSelector.h"
+#include "DSPOpenGL.h"
+#include "DSPCPU.h"
+#include "DSPVoices.h"
+
+struct DSPEngineSettings
+{
+    DSPBackend      backend = DSPBackendOpenCL;
+    size_t          sampleRate = 44100;
+    size_t          bufferSize = 4096;          // frames the ring holds, or frames per call in fixed block mode
+    size_t          channelsCount = 1;
+    glm::ivec2      gridSize = glm::ivec2(16, 16);
+    CellsMode       cellsMode = CellsModeContinuous;   // OpenCL only, the CPU engine is continuous
+    uint64_t        seed = 0;                   // 0 takes one from the clock
+    DSPRingMode     ringMode = DSPRingDirect;
+    DSPBlockMode    blockMode = DSPBlockRing;
+    std::string     clDevice;                   // OpenCL device index or part of its name, empty picks by benchmark
+    std::string     clDeviceCache;              // file keeping the benchmark pick, empty benchmarks every time
+    double          latencyBudget = 0.0;        // seconds an OpenCL block may take, 0 allows half of its duration
+    double          latencyTarget = 0.02;       // seconds of output latency LatencyTuner aims for in ring block mode
+    double          snapshotRate = 60.0;        // grid snapshots per second of audio for the visualizer, 0 after every block
+    size_t          voicesCapacity = 32;        // Voices only, slots of the slab
+    size_t          voicesCount = 1;            // Voices only, voices sounding from the start, voice 0 included
+};
+
+// benchmarks the OpenCL devices on the workload of \a settings, see selectCLDevice
+inline bool _selectDSPDevice(const DSPEngineSettings& settings)
+{
+    CLDeviceSelectorSettings selector;
+    selector.override = settings.clDevice;
+    selector.cachePath = settings.clDeviceCache;
+    selector.sampleRate = settings.sampleRate;
+    selector.bufferSize = settings.bufferSize;
+    selector.channelsCount = settings.channelsCount;
+    selector.gridSize = settings.gridSize;
+    selector.cellsMode = settings.cellsMode;
+    selector.latencyBudget = settings.latencyBudget;
+    return selectCLDevice(selector) != NULL;
+}
+
+inline bool isDSPBackendAvailable(DSPBackend backend)
+{
+    switch (backend)
+    {
+        case DSPBackendOpenCL: return DSPOpenCL::isAvailable();
+        case DSPBackendVoices: return DSPOpenCL::isAvailable();
+        case DSPBackendOpenGL: return DSPOpenGL::isAvailable();
+        case DSPBackendCPU: return true;
+    }
+    return false;
+}
+
+//! Builds the engine \a settings ask for, or a DSPCPU one if its device is missing. getBackend tells which one it is.
+//! OpenCL engines run on the device selectCLDevice picks for the workload.
+inline DSPEngine* createDSPEngine(const DSPEngineSettings& settings)
+{
+    DSPBackend backend = isDSPBackendAvailable(settings.backend) ? settings.backend : DSPBackendCPU;
+    if (backend == DSPBackendOpenCL && !_selectDSPDevice(settings))
+        backend = DSPBackendCPU;
+#if LOGENABLED
+    if (backend != settings.backend)
+        std::cerr << "[Engine]: no " << getDSPBackendName(settings.backend) << " device, falling back to " << getDSPBackendName(backend) << std::endl;
+#endif
+
+    DSPEngine* engine = NULL;
+    if (backend == DSPBackendVoices)
+    {
+        DSPVoices* voices = new DSPVoices(settings.sampleRate, settings.bufferSize, settings.voicesCapacity, settings.gridSize, settings.channelsCount, settings.seed);
+        if (voices->isReady())
+        {
+            // the other voices start from the rules of voice 0 with seeds of their own, the gains keep the mix in range
+            size_t voicesCount = std::max<size_t>(1, std::min(settings.voicesCount, settings.voicesCapacity));
+            for (size_t voice = 1; voice < voicesCount; ++voice)
+                voices->allocateVoice(voices->getRulesBirthCenter(), voices->getSeed() + voice);
+            for (size_t voice = 0; voice < voicesCount; ++voice)
+                voices->setVoiceGain((int)voice, 1.0f / (float)voicesCount);
+            engine = voices;
+        }
+        else
+        {
+            // a voice is one work group, a grid past the work group size of the device gets no voices engine
+            delete voices;
+            backend = DSPBackendCPU;
+#if LOGENABLED
+            std::cerr << "[Engine]: a " << settings.gridSize.x << "x" << settings.gridSize.y << " grid does not fit a voice, falling back to " << getDSPBackendName(backend) << std::endl;
+#endif
+        }
+    }
+
+    switch (backend)
+    {
+        case DSPBackendOpenCL:
+            engine = new DSPOpenCL(settings.sampleRate, settings.bufferSize, settings.cellsMode, settings.gridSize, settings.channelsCount, settings.seed);
+            break;
+        case DSPBackendOpenGL:
+            engine = new DSPOpenGL(settings.sampleRate, settings.bufferSize);
+            break;
+        case DSPBackendCPU:
+            engine = new DSPCPU(settings.sampleRate, settings.bufferSize, settings.gridSize, settings.channelsCount, settings.seed);
+            break;
+        case DSPBackendVoices:
+            break;
+    }
+    engine->setRingMode(settings.ringMode);
+    engine->setSnapshotInterval(settings.snapshotRate > 0.0 ? (size_t)(settings.sampleRate / settings.snapshotRate) : 0);
+    // transform feedback needs the GL context, which the audio callback does not have
+    engine->setBlockMode(backend == DSPBackendOpenGL ? DSPBlockRing : settings.blockMode);
+    return engine;
+}
+
+#endif /* DSPEngines_h */
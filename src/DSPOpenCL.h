@@ -10,107 +10,54 @@
 #define DSPOpenCL_h
 
 #include "Utils.h"
-#include <OpenCL/OpenCL.h>
-#include "cinder/app/cocoa/PlatformCocoa.h"
+#include "DSPEngine.h"
+#include "BinaryAutomaton.h"
+#include "CellsCPU.h"
+#include "Convolution.h"
+#include "Neighbourhood.h"
+#include "ControlRate.h"
+#include "MixingMatrix.h"
+#include "HashLife.h"
+#include "CycleDetector.h"
+#include "Philox.h"
+#include "Snapshot.h"
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include "OpenCLUtils.h"
 
-typedef cl_float        DSPSampleType;
-typedef cl_float4       DSPSampleType4;
+static_assert(sizeof(DSPSampleType4) == sizeof(cl_float4), "cells are copied to cl_float4 buffers as they are");
 
-#if UNSAFEBUFFER
-#include "UnsafeRingBuffer.h"
-typedef UnsafeRingBufferT<DSPSampleType> RingBuffer;
-#else
-#include "cinder/audio/audio.h"
-#include "cinder/audio/dsp/Dsp.h"
-typedef ci::audio::dsp::RingBufferT<DSPSampleType> RingBuffer;
-#endif
+// Moore neighbourhood of radius 1, see ruleRadius in Cells.ncl
+const cl_uint           ruleNeighboursCount = 8;
+// (state, neighbour sum) -> next state entries the rule table buffer can hold
+const size_t            ruleTableMaxLength = 4096;
+// work group size of the BitCells.ncl step kernel, power of two for its popcount reduction
+const size_t            bitStepGroupSize = 64;
+// side of the activity tracking tiles, see tileChanged in Cells.ncl
+const cl_uint           cellsTileSize = 8;
+// upper bounds of the Processing.ncl mixdown reduction, work group size and work groups per generation
+const size_t            mixdownMaxGroupSize = 256;
+const size_t            mixdownMaxGroupsCount = 256;
+// most oscillators of ControlOscillators, grid rows are averaged into this many bands
+const size_t            controlBandsMaxCount = 64;
+
+enum CellsMode
+{
+    CellsModeContinuous,    // float4 cells, Cells.ncl + Processing.ncl
+    CellsModeBinary,        // bit-packed Life-like cells, BitCells.ncl
+    CellsModeBinaryHost,    // bit-packed Life-like cells stepped by BitGrid on the host
+    CellsModeContinuousHost // float cells stepped by CellsCPU on the host
+};
 
-class DSPOpenCL
+class DSPOpenCL : public DSPEngine
 {
 private:    
-    const char* getErrorString(cl_int error)
-    {
-        switch(error)
-        {
-            // run-time and JIT compiler errors
-            case 0: return "CL_SUCCESS";
-            case -1: return "CL_DEVICE_NOT_FOUND";
-            case -2: return "CL_DEVICE_NOT_AVAILABLE";
-            case -3: return "CL_COMPILER_NOT_AVAILABLE";
-            case -4: return "CL_MEM_OBJECT_ALLOCATION_FAILURE";
-            case -5: return "CL_OUT_OF_RESOURCES";
-            case -6: return "CL_OUT_OF_HOST_MEMORY";
-            case -7: return "CL_PROFILING_INFO_NOT_AVAILABLE";
-            case -8: return "CL_MEM_COPY_OVERLAP";
-            case -9: return "CL_IMAGE_FORMAT_MISMATCH";
-            case -10: return "CL_IMAGE_FORMAT_NOT_SUPPORTED";
-            case -11: return "CL_BUILD_PROGRAM_FAILURE";
-            case -12: return "CL_MAP_FAILURE";
-            case -13: return "CL_MISALIGNED_SUB_BUFFER_OFFSET";
-            case -14: return "CL_EXEC_STATUS_ERROR_FOR_EVENTS_IN_WAIT_LIST";
-            case -15: return "CL_COMPILE_PROGRAM_FAILURE";
-            case -16: return "CL_LINKER_NOT_AVAILABLE";
-            case -17: return "CL_LINK_PROGRAM_FAILURE";
-            case -18: return "CL_DEVICE_PARTITION_FAILED";
-            case -19: return "CL_KERNEL_ARG_INFO_NOT_AVAILABLE";
-                
-            // compile-time errors
-            case -30: return "CL_INVALID_VALUE";
-            case -31: return "CL_INVALID_DEVICE_TYPE";
-            case -32: return "CL_INVALID_PLATFORM";
-            case -33: return "CL_INVALID_DEVICE";
-            case -34: return "CL_INVALID_CONTEXT";
-            case -35: return "CL_INVALID_QUEUE_PROPERTIES";
-            case -36: return "CL_INVALID_COMMAND_QUEUE";
-            case -37: return "CL_INVALID_HOST_PTR";
-            case -38: return "CL_INVALID_MEM_OBJECT";
-            case -39: return "CL_INVALID_IMAGE_FORMAT_DESCRIPTOR";
-            case -40: return "CL_INVALID_IMAGE_SIZE";
-            case -41: return "CL_INVALID_SAMPLER";
-            case -42: return "CL_INVALID_BINARY";
-            case -43: return "CL_INVALID_BUILD_OPTIONS";
-            case -44: return "CL_INVALID_PROGRAM";
-            case -45: return "CL_INVALID_PROGRAM_EXECUTABLE";
-            case -46: return "CL_INVALID_KERNEL_NAME";
-            case -47: return "CL_INVALID_KERNEL_DEFINITION";
-            case -48: return "CL_INVALID_KERNEL";
-            case -49: return "CL_INVALID_ARG_INDEX";
-            case -50: return "CL_INVALID_ARG_VALUE";
-            case -51: return "CL_INVALID_ARG_SIZE";
-            case -52: return "CL_INVALID_KERNEL_ARGS";
-            case -53: return "CL_INVALID_WORK_DIMENSION";
-            case -54: return "CL_INVALID_WORK_GROUP_SIZE";
-            case -55: return "CL_INVALID_WORK_ITEM_SIZE";
-            case -56: return "CL_INVALID_GLOBAL_OFFSET";
-            case -57: return "CL_INVALID_EVENT_WAIT_LIST";
-            case -58: return "CL_INVALID_EVENT";
-            case -59: return "CL_INVALID_OPERATION";
-            case -60: return "CL_INVALID_GL_OBJECT";
-            case -61: return "CL_INVALID_BUFFER_SIZE";
-            case -62: return "CL_INVALID_MIP_LEVEL";
-            case -63: return "CL_INVALID_GLOBAL_WORK_SIZE";
-            case -64: return "CL_INVALID_PROPERTY";
-            case -65: return "CL_INVALID_IMAGE_DESCRIPTOR";
-            case -66: return "CL_INVALID_COMPILER_OPTIONS";
-            case -67: return "CL_INVALID_LINKER_OPTIONS";
-            case -68: return "CL_INVALID_DEVICE_PARTITION_COUNT";
-                
-            // extension errors
-            case -1000: return "CL_INVALID_GL_SHAREGROUP_REFERENCE_KHR";
-            case -1001: return "CL_PLATFORM_NOT_FOUND_KHR";
-            case -1002: return "CL_INVALID_D3D10_DEVICE_KHR";
-            case -1003: return "CL_INVALID_D3D10_RESOURCE_KHR";
-            case -1004: return "CL_D3D10_RESOURCE_ALREADY_ACQUIRED_KHR";
-            case -1005: return "CL_D3D10_RESOURCE_NOT_ACQUIRED_KHR";
-            default: return "Unknown OpenCL error";
-        }
-    }
-    
     void logErrorString(cl_int error)
     {
-#if LOGENABLED
-        std::cerr << "[OpenCL error]: " << getErrorString(error) << std::endl;
-#endif
+        logCLError(error);
     }
     
     
@@ -119,9 +66,30 @@ protected:
     cl_context          context;
     cl_command_queue    commandQueue;
     
-    cl_program          program;
     cl_kernel           cellsKernel;
+    cl_kernel           seedKernel;
+    cl_kernel           tileSumsKernel;
     cl_kernel           soundKernel;
+    cl_kernel           mixdownReduceKernel;
+    cl_kernel           mixdownFinishKernel;
+    cl_kernel           mixdownTilesKernel;
+    cl_mem              mixdownPartialsMemoryObj;
+    size_t              mixdownGroupSize;
+    cl_uint             mixdownGroupsCount;
+    
+    size_t              channelsCount;
+    MixingMatrix*       mixing;
+    MixingMatrix*       mixingPending;
+    std::mutex          mixingMutex;
+    cl_kernel           mixReduceKernel;
+    cl_kernel           mixFinishKernel;
+    cl_mem              mixWeightsMemoryObj;
+    cl_mem              mixOffsetsMemoryObj;
+    cl_mem              mixPartialsMemoryObj;
+    cl_mem              mixFramesMemoryObj;
+    bool                isMixingPrepared;
+    std::vector<float>  mixFrames;
+    std::vector<float>  mixPlane;
     
     DSPSampleType*      samples;
     cl_mem              samplesMemoryObj;
@@ -140,72 +108,110 @@ protected:
     size_t              rulesMemoryLength;
     cl_float*           rules;
     
+    cl_mem              ruleTableMemoryObj;
+    cl_float*           ruleTable;
+    cl_uint             ruleTableLevels;
+    cl_float            ruleTableRules[5];
+    bool                isRuleTableCustom;
+    bool                isQuantized;
+    
     cl_uint2            gridSize;
     
+    CellsMode           cellsMode;
+    BitGrid*            bitGrid;
+    BinaryRule          binaryRule;
+    cl_kernel           bitStepKernel;
+    cl_kernel           bitMixdownKernel;
+    cl_mem              bitCellsMemoryObj[2];
+    cl_mem              bitCountsMemoryObj;
+    cl_uint2            bitWordsGrid;
+    size_t              bitCurrent;
+    HashLife*           hashLife;
+    cl_uint             fastForwardPendingLog2;
+    bool                isFastForwardDirty;
+    CellsCPU*           cellsCPU;
+    ThreadPool*         cellsThreadPool;
+    size_t              cellsBlockGenerations;
+    size_t              cellsBlockThreads;
+    bool                isCellsBlockingDirty;
+    
+    ConvolutionCPU*     convolution;
+    bool                isConvolutionEnabled;
+    cl_kernel           convolutionLoadKernel;
+    cl_kernel           convolutionPassKernel;
+    cl_kernel           convolutionMultiplyKernel;
+    cl_kernel           convolutionApplyKernel;
+    cl_mem              convolutionMemoryObj[2];
+    cl_mem              convolutionSpectrumMemoryObj;
+    bool                isConvolutionPrepared;
+    
+    Neighbourhood       neighbourhood;
+    cl_kernel           windowRowsKernel;
+    cl_kernel           windowColumnsKernel;
+    
+    cl_mem              tileChangedMemoryObj;
+    cl_mem              tileSumsMemoryObj;
+    cl_mem              tileQuietRunsMemoryObj;
+    cl_uint2            tilesGrid;
+    bool                isTilesDirty;
+    
+    cl_uint             boundaryMode;
+    cl_float            boundaryValue;
+    
+    // settings the UI changes while a block may be computing, applied by _applySettings at the start of the next one
+    std::mutex          settingsMutex;
+    bool                pendingQuantized;
+    bool                isQuantizedDirty;
+    bool                pendingCycleDetection;
+    bool                isCycleDetectionDirty;
+    cl_uint             pendingBoundaryMode;
+    cl_float            pendingBoundaryValue;
+    bool                isBoundaryDirty;
+    Neighbourhood       pendingNeighbourhood;
+    bool                isNeighbourhoodDirty;
+    // a kernel to enable or the neighbourhood to go back to, after any pending neighbourhood
+    ConvolutionKernel   pendingConvolutionKernel;
+    bool                pendingConvolutionEnabled;
+    bool                isConvolutionDirty;
+    
+    CycleDetector*      cycleDetector;
+    std::vector<uint8_t> cycleState;
+    std::vector<uint8_t> cycleFirstState;
+    cl_float            cycleRules[5];
+    bool                isCycleDetectionEnabled;
+    bool                isReplaying;
+    
+    ControlRate         controlRate;
+    std::vector<float>  controlOutput;
+    std::vector<float>  controlBands;
+    std::vector<float>  controlPlane;
+    size_t              controlPendingInterval;
+    ControlInterpolation controlPendingMode;
+    bool                isControlRateDirty;
+    
+    cl_ulong            seed;
+    cl_ulong            pendingSeed;
+    bool                isSeedDirty;
+    
+    std::mutex          snapshotMutex;
+    std::vector<std::string> snapshotSavePaths;
+    std::shared_ptr<SnapshotFile> snapshotPending;
+    // grid copy the writer reads from, owned by the engine and shared with the writer until the save is written
+    std::shared_ptr<std::vector<DSPSampleType4>> snapshotStaging;
+    SnapshotWriter      snapshotWriter;
+    
     cl_uint             samplesProcessed;
+    cl_uint             generationsProcessed;
     cl_uint             sampleRate;
     cl_uint             samplesToWrite;
     size_t              bufferSize;
     
     bool                isPaused;
+    bool                isDeviceReady;
     
-    void _prepareContext()
-    {
-        cl_platform_id platformID;
-        cl_uint numPlatforms;
-        cl_int ret = clGetPlatformIDs(1, &platformID, &numPlatforms);
-        logErrorString(ret);
-        
-        cl_uint numDevices;
-        ret = clGetDeviceIDs(platformID, CL_DEVICE_TYPE_GPU, 1, &deviceID, &numDevices);
-        logErrorString(ret);
-        
-#if LOGENABLED
-        size_t extInfoSize = 0;
-        clGetDeviceInfo(deviceID, CL_DEVICE_EXTENSIONS, NULL, NULL, &extInfoSize);
-        logErrorString(ret);
-        char* info = new char[extInfoSize];
-        clGetDeviceInfo(deviceID, CL_DEVICE_EXTENSIONS, extInfoSize, info, NULL);
-        logErrorString(ret);
-        std::cout << "[OpenCL SUPPORTED EXTENSIONS] : " << info << std::endl;
-        delete [] info;
-#endif
-        
-        context = clCreateContext(NULL, 1, &deviceID, NULL, NULL, &ret);
-        logErrorString(ret);
-        
-        commandQueue = clCreateCommandQueue(context, deviceID, 0, &ret);
-        logErrorString(ret);
-    }
-    
-    void _prepareKernel(cl_kernel* kernelPtr, const std::string& sourceFile)
+    void _prepareKernels(const std::string& sourceFile, std::initializer_list<std::pair<cl_kernel*, const char*>> kernels)
     {
-        cl_int ret = 0;
-        program = NULL;
-        *kernelPtr = NULL;
-        
-        std::string clSrcString = readAllText(cinder::app::PlatformCocoa::get()->getResourcePath(sourceFile).string());
-        const char* str = clSrcString.c_str();
-        size_t sourceSize = clSrcString.length();
-        
-        program = clCreateProgramWithSource(context, 1, &str, &sourceSize, &ret);
-        logErrorString(ret);
-        ret = clBuildProgram(program, 1, &deviceID, NULL, NULL, NULL);
-        logErrorString(ret);
-        
-#if LOGENABLED
-        size_t len = 0;
-        clGetProgramBuildInfo(program, deviceID, CL_PROGRAM_BUILD_LOG, NULL, NULL, &len);
-        char* log = new char[len];
-        clGetProgramBuildInfo(program, deviceID, CL_PROGRAM_BUILD_LOG, len, log, NULL);
-        std::cerr << log << std::endl;
-        delete [] log;
-#endif
-        
-        *kernelPtr = clCreateKernel(program, "kernelMain", &ret);
-        logErrorString(ret);
-        
-        clReleaseProgram(program);
+        isDeviceReady &= prepareCLKernels(deviceID, context, sourceFile, kernels);
     }
     
     void _setupKernelVars(cl_kernel targetKernel)
@@ -226,18 +232,32 @@ protected:
         logErrorString(ret);
         ret = clSetKernelArg(targetKernel, 7, sizeof(cl_uint2), (void*)&gridSize);
         logErrorString(ret);
+        ret = clSetKernelArg(targetKernel, 8, sizeof(cl_mem), (void*)&ruleTableMemoryObj);
+        logErrorString(ret);
+        ret = clSetKernelArg(targetKernel, 9, sizeof(cl_uint), (void*)&ruleTableLevels);
+        logErrorString(ret);
+        ret = clSetKernelArg(targetKernel, 10, sizeof(cl_mem), (void*)&tileChangedMemoryObj);
+        logErrorString(ret);
+        ret = clSetKernelArg(targetKernel, 11, sizeof(cl_mem), (void*)&tileQuietRunsMemoryObj);
+        logErrorString(ret);
+        ret = clSetKernelArg(targetKernel, 12, sizeof(cl_uint), (void*)&cellsTileSize);
+        logErrorString(ret);
+        ret = clSetKernelArg(targetKernel, 13, sizeof(cl_uint), (void*)&boundaryMode);
+        logErrorString(ret);
+        ret = clSetKernelArg(targetKernel, 14, sizeof(cl_float), (void*)&boundaryValue);
+        logErrorString(ret);
     }
     
     void _prepareMemory()
     {
         cl_int ret = 0;
-        srand(time(0));
         
         // samples
         samplesMemoryObj = NULL;
         samplesMemoryLength = bufferSize;
-        samples = new DSPSampleType[samplesMemoryLength];
-        for (int i = 0; i < samplesMemoryLength; ++i)
+        // the host copy also stages interleaved frames on their way to the ring buffer
+        samples = new DSPSampleType[samplesMemoryLength * channelsCount];
+        for (size_t i = 0; i < samplesMemoryLength * channelsCount; ++i)
             samples[i] = 0;
         samplesMemoryObj = clCreateBuffer(context, CL_MEM_READ_WRITE, samplesMemoryLength * sizeof(DSPSampleType), NULL, &ret);
         logErrorString(ret);        ret = clEnqueueWriteBuffer(commandQueue, samplesMemoryObj, CL_TRUE, 0, samplesMemoryLength * sizeof(DSPSampleType), samples, 0, NULL, NULL);
@@ -282,12 +302,27 @@ protected:
         ret = clEnqueueWriteBuffer(commandQueue, rulesMemoryObject, CL_TRUE, 0, rulesMemoryLength * sizeof(cl_float), rules, 0, NULL, NULL);
         logErrorString(ret);
         
-        // cells
-        gridSize = { 16, 16 };
+        // rule table, filled by _updateRuleTable once quantized mode is on
+        ruleTableMemoryObj = NULL;
+        ruleTableLevels = 0;
+        isRuleTableCustom = false;
+        isQuantized = false;
+        ruleTable = new cl_float[ruleTableMaxLength];
+        for (size_t i = 0; i < ruleTableMaxLength; ++i)
+            ruleTable[i] = 0.0f;
+        for (size_t i = 0; i < rulesMemoryLength; ++i)
+            ruleTableRules[i] = rules[i];
+        ruleTableMemoryObj = clCreateBuffer(context, CL_MEM_READ_ONLY, ruleTableMaxLength * sizeof(cl_float), NULL, &ret);
+        logErrorString(ret);
+        ret = clEnqueueWriteBuffer(commandQueue, ruleTableMemoryObj, CL_TRUE, 0, ruleTableMaxLength * sizeof(cl_float), ruleTable, 0, NULL, NULL);
+        logErrorString(ret);
+        
+        // cells, binary modes keep no per-sample history
         cellsCount = gridSize.s[0] * gridSize.s[1];
-        cellsMemoryLength = cellsCount * bufferSize;
+        cellsMemoryLength = cellsCount * (cellsMode == CellsModeContinuous ? bufferSize : 1);
         cells = new DSPSampleType4[cellsMemoryLength];
         DefferedUpdateGrid = new DSPSampleType4[cellsCount];
+        snapshotStaging = std::make_shared<std::vector<DSPSampleType4>>(cellsCount);
         for (int i = 0; i < cellsMemoryLength; ++i)
         {
             for (int j = 0; j < 4; ++j)
@@ -298,234 +333,1717 @@ protected:
         }
         
         for (int i = 0; i < cellsCount; ++i)
-        {
-            cells[i].s[0] = randAmp();
-            //cells[i].s[1] = randFreq();
-        }
+            cells[i].s[0] = philoxCellUniform(seed, i);
         
         cellsMemoryObj = clCreateBuffer(context, CL_MEM_READ_WRITE, cellsMemoryLength * sizeof(DSPSampleType4), NULL, &ret);
         logErrorString(ret);
         ret = clEnqueueWriteBuffer(commandQueue, cellsMemoryObj, CL_TRUE, 0, cellsMemoryLength * sizeof(DSPSampleType4), cells, 0, NULL, NULL);
         logErrorString(ret);
         
+        // whether each tile changed in the last two generations, unchanged generations in a row and the sum of each tile
+        // in each slot, written by Cells.ncl and reset by _resetTiles
+        tilesGrid = { (gridSize.s[0] + cellsTileSize - 1) / cellsTileSize, (gridSize.s[1] + cellsTileSize - 1) / cellsTileSize };
+        tileChangedMemoryObj = clCreateBuffer(context, CL_MEM_READ_WRITE, 2 * tilesGrid.s[0] * tilesGrid.s[1] * sizeof(cl_uint), NULL, &ret);
+        logErrorString(ret);
+        tileSumsMemoryObj = clCreateBuffer(context, CL_MEM_READ_WRITE, bufferSize * tilesGrid.s[0] * tilesGrid.s[1] * sizeof(DSPSampleType), NULL, &ret);
+        logErrorString(ret);
+        tileQuietRunsMemoryObj = clCreateBuffer(context, CL_MEM_READ_WRITE, tilesGrid.s[0] * tilesGrid.s[1] * sizeof(cl_uint), NULL, &ret);
+        logErrorString(ret);
+        isTilesDirty = true;
+        
+        if (cellsMode == CellsModeContinuousHost)
+        {
+            cellsCPU = new CellsCPU(gridSize.s[0], gridSize.s[1], cellsTileSize);
+            cellsCPU->load(&cells[0].s[0], 4);
+        }
+        
         _setupKernelVars(cellsKernel);
         _setupKernelVars(soundKernel);
-    }
-
-    
-    size_t _getBufferToWrite()
-    {
-#if FIXEDBUFFER
-        return bufferSize;
-#else
-        return RingBuffer.getAvailableWrite();
-#endif
-    }
-
-    void _updateSamplesProcessed()
-    {
-        clSetKernelArg(cellsKernel, 3, sizeof(cl_uint), (void*)&samplesProcessed);
-        clSetKernelArg(soundKernel, 3, sizeof(cl_uint), (void*)&samplesProcessed);
+        _setupTileKernels();
+        _prepareMixdown();
+        
+        // binary modes have no per-cell states to weight and copy the mono mixdown to every channel
+        mixing = new MixingMatrix(gridSize.s[0], gridSize.s[1]);
+        if (!_isBinaryMode())
+            mixing->setChannels(channelsCount);
+        mixFrames.resize(bufferSize * channelsCount);
+        mixPlane.resize(cellsCount);
+        _uploadMixing();
+        
+        if (_isBinaryMode())
+            _prepareBinaryMemory();
+        
+        _prepareCycleDetector();
     }
     
-    void _updateSamplesToWrite(size_t newValue)
+    // arguments past the ones cellsKernel shares with soundKernel, the generation index is set per launch
+    void _setupTileKernels()
     {
-        samplesToWrite = (cl_uint)newValue;
-        clSetKernelArg(cellsKernel, 4, sizeof(cl_uint), (void*)&samplesToWrite);
-        clSetKernelArg(soundKernel, 4, sizeof(cl_uint), (void*)&samplesToWrite);
+        cl_int ret = clSetKernelArg(cellsKernel, 15, sizeof(cl_mem), (void*)&tileSumsMemoryObj);
+        logErrorString(ret);
+        ret = clSetKernelArg(cellsKernel, 17, cellsTileSize * cellsTileSize * sizeof(DSPSampleType), NULL);
+        logErrorString(ret);
+        
+        ret = clSetKernelArg(tileSumsKernel, 0, sizeof(cl_mem), (void*)&cellsMemoryObj);
+        logErrorString(ret);
+        ret = clSetKernelArg(tileSumsKernel, 1, sizeof(cl_mem), (void*)&tileSumsMemoryObj);
+        logErrorString(ret);
+        ret = clSetKernelArg(tileSumsKernel, 2, sizeof(cl_uint2), (void*)&gridSize);
+        logErrorString(ret);
+        ret = clSetKernelArg(tileSumsKernel, 3, sizeof(cl_uint), (void*)&cellsTileSize);
+        logErrorString(ret);
+        ret = clSetKernelArg(tileSumsKernel, 4, cellsTileSize * cellsTileSize * sizeof(DSPSampleType), NULL);
+        logErrorString(ret);
     }
     
-    void _applyDefferedUpdateGrid()
+    void _prepareMixdown()
     {
-        for (int i = 0; i < cellsCount; ++i)
-        {
-            float replaceMask = DefferedUpdateGrid[i].s[0] > 0.0f ? 1.0f : 0.0f;
-            float clearMask = DefferedUpdateGrid[i].s[0] < 0.0f ? 1.0f : 0.0f;
-            
-#if LOGENABLED
-            bool log = false;
-            if (replaceMask == 1.0)
-            {
-                log = true;
-                std::cout << "[Cells]: Replaced[" << i << "]" << std::endl;
-            }
-            if (clearMask == 1.0)
-            {
-                log = true;
-                std::cout << "[Cells]: Cleared[" << i << "]" << std::endl;
-            }
-#endif
-            for (int j = 0; j < 4; ++j)
-            {
-                cells[i].s[j] = (replaceMask * DefferedUpdateGrid[i].s[j] + (1.0f - replaceMask) * cells[i].s[j]) * (1.0f - clearMask);
-                DefferedUpdateGrid[i].s[j] = 0.0f;
-#if LOGENABLED
-                if (log)
-                    std::cout << "[Cells]: New value[" << i << "][" << j << "] = " << cells[i].s[j] << std::endl;
-#endif
-            }
-        }
+        cl_int ret = 0;
         
-        clEnqueueWriteBuffer(commandQueue, cellsMemoryObj, CL_TRUE, 0, cellsCount * sizeof(DSPSampleType4), cells, 0, NULL, NULL);
+        // largest power of two the device runs the reduction with
+        size_t deviceGroupSize = mixdownMaxGroupSize;
+        ret = clGetKernelWorkGroupInfo(mixdownReduceKernel, deviceID, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &deviceGroupSize, NULL);
+        logErrorString(ret);
+        mixdownGroupSize = 1;
+        while (mixdownGroupSize * 2 <= std::min(deviceGroupSize, mixdownMaxGroupSize))
+            mixdownGroupSize *= 2;
+        mixdownGroupsCount = (cl_uint)std::min((cellsCount + mixdownGroupSize - 1) / mixdownGroupSize, mixdownMaxGroupsCount);
+        
+        mixdownPartialsMemoryObj = clCreateBuffer(context, CL_MEM_READ_WRITE, bufferSize * mixdownGroupsCount * sizeof(DSPSampleType), NULL, &ret);
+        logErrorString(ret);
+        
+        cl_uint cellsCountArg = (cl_uint)cellsCount;
+        ret = clSetKernelArg(mixdownReduceKernel, 0, sizeof(cl_mem), (void*)&cellsMemoryObj);
+        logErrorString(ret);
+        ret = clSetKernelArg(mixdownReduceKernel, 1, sizeof(cl_mem), (void*)&mixdownPartialsMemoryObj);
+        logErrorString(ret);
+        ret = clSetKernelArg(mixdownReduceKernel, 2, sizeof(cl_uint), (void*)&cellsCountArg);
+        logErrorString(ret);
+        ret = clSetKernelArg(mixdownReduceKernel, 3, mixdownGroupSize * sizeof(DSPSampleType), NULL);
+        logErrorString(ret);
+        ret = clSetKernelArg(mixdownFinishKernel, 0, sizeof(cl_mem), (void*)&samplesMemoryObj);
+        logErrorString(ret);
+        ret = clSetKernelArg(mixdownFinishKernel, 1, sizeof(cl_mem), (void*)&mixdownPartialsMemoryObj);
+        logErrorString(ret);
+        ret = clSetKernelArg(mixdownFinishKernel, 2, sizeof(cl_uint), (void*)&mixdownGroupsCount);
+        logErrorString(ret);
+        ret = clSetKernelArg(mixdownFinishKernel, 3, sizeof(cl_uint), (void*)&cellsCountArg);
+        logErrorString(ret);
+        ret = clSetKernelArg(mixdownFinishKernel, 4, mixdownGroupSize * sizeof(DSPSampleType), NULL);
+        logErrorString(ret);
+        
+        cl_uint tilesCountArg = tilesGrid.s[0] * tilesGrid.s[1];
+        ret = clSetKernelArg(mixdownTilesKernel, 0, sizeof(cl_mem), (void*)&tileSumsMemoryObj);
+        logErrorString(ret);
+        ret = clSetKernelArg(mixdownTilesKernel, 1, sizeof(cl_mem), (void*)&mixdownPartialsMemoryObj);
+        logErrorString(ret);
+        ret = clSetKernelArg(mixdownTilesKernel, 2, sizeof(cl_uint), (void*)&tilesCountArg);
+        logErrorString(ret);
+        ret = clSetKernelArg(mixdownTilesKernel, 3, mixdownGroupSize * sizeof(DSPSampleType), NULL);
+        logErrorString(ret);
     }
     
-public:
-    RingBuffer RingBuffer;
-    DSPSampleType4*   DefferedUpdateGrid;
-    
-    DSPOpenCL(size_t initSampleRate, size_t initBufferSize) :
-    RingBuffer(initBufferSize)
+    // one sample per generation in the history slots, reduced by work groups instead of a serial loop per sample.
+    // The stencil path keeps tile sums and reduces those instead of the cells.
+    void _mixdown(size_t toWrite, bool fromTiles = false)
     {
-        this->samplesProcessed = 0;
-        this->sampleRate = (cl_uint)initSampleRate;
-        this->bufferSize = initBufferSize;
-        this->samplesToWrite = (cl_uint)initBufferSize;
+        size_t localWorkSize[2] = { mixdownGroupSize, 1 };
+        size_t globalWorkSize[2] = { mixdownGroupsCount * mixdownGroupSize, toWrite };
+        clEnqueueNDRangeKernel(commandQueue, fromTiles ? mixdownTilesKernel : mixdownReduceKernel, 2, NULL, globalWorkSize, localWorkSize, 0, NULL, NULL);
         
-        _prepareContext();
-        _prepareKernel(&cellsKernel, "Cells.ncl");
-        _prepareKernel(&soundKernel, "Processing.ncl");
-        _prepareMemory();
-        isPaused = false;
+        globalWorkSize[0] = mixdownGroupSize;
+        clEnqueueNDRangeKernel(commandQueue, mixdownFinishKernel, 2, NULL, globalWorkSize, localWorkSize, 0, NULL, NULL);
+        
+        if (_isMixing())
+            _mixChannels(toWrite);
     }
     
-    float* getRulesBirthCenter()
-    {
-        return &rules[0];
-    }
-    float* rulesBirthRadius()
-    {
-        return &rules[1];
-    }
-    float* rulesKeepCenter()
-    {
-        return &rules[2];
-    }
-    float* rulesKeepRadius()
-    {
-        return &rules[3];
-    }
-    float* rulesSpeed()
+    // device buffers of the mixing matrix, made the first time a matrix other than the mean is used
+    void _prepareMixing()
     {
-        return &rules[4];
+        cl_int ret = 0;
+        if (isMixingPrepared || cellsMode != CellsModeContinuous)
+            return;
+        isMixingPrepared = true;
+        
+        mixWeightsMemoryObj = clCreateBuffer(context, CL_MEM_READ_ONLY, cellsCount * channelsCount * sizeof(cl_float), NULL, &ret);
+        logErrorString(ret);
+        mixOffsetsMemoryObj = clCreateBuffer(context, CL_MEM_READ_ONLY, channelsCount * sizeof(cl_float), NULL, &ret);
+        logErrorString(ret);
+        mixPartialsMemoryObj = clCreateBuffer(context, CL_MEM_READ_WRITE, bufferSize * channelsCount * mixdownGroupsCount * sizeof(DSPSampleType), NULL, &ret);
+        logErrorString(ret);
+        mixFramesMemoryObj = clCreateBuffer(context, CL_MEM_READ_WRITE, bufferSize * channelsCount * sizeof(DSPSampleType), NULL, &ret);
+        logErrorString(ret);
+        
+        cl_uint cellsCountArg = (cl_uint)cellsCount;
+        cl_uint channelsCountArg = (cl_uint)channelsCount;
+        ret = clSetKernelArg(mixReduceKernel, 0, sizeof(cl_mem), (void*)&cellsMemoryObj);
+        logErrorString(ret);
+        ret = clSetKernelArg(mixReduceKernel, 1, sizeof(cl_mem), (void*)&mixWeightsMemoryObj);
+        logErrorString(ret);
+        ret = clSetKernelArg(mixReduceKernel, 2, sizeof(cl_mem), (void*)&mixPartialsMemoryObj);
+        logErrorString(ret);
+        ret = clSetKernelArg(mixReduceKernel, 3, sizeof(cl_uint), (void*)&cellsCountArg);
+        logErrorString(ret);
+        ret = clSetKernelArg(mixReduceKernel, 4, sizeof(cl_uint), (void*)&channelsCountArg);
+        logErrorString(ret);
+        ret = clSetKernelArg(mixReduceKernel, 5, mixdownGroupSize * sizeof(DSPSampleType), NULL);
+        logErrorString(ret);
+        ret = clSetKernelArg(mixFinishKernel, 0, sizeof(cl_mem), (void*)&mixFramesMemoryObj);
+        logErrorString(ret);
+        ret = clSetKernelArg(mixFinishKernel, 1, sizeof(cl_mem), (void*)&mixPartialsMemoryObj);
+        logErrorString(ret);
+        ret = clSetKernelArg(mixFinishKernel, 2, sizeof(cl_mem), (void*)&mixOffsetsMemoryObj);
+        logErrorString(ret);
+        ret = clSetKernelArg(mixFinishKernel, 3, sizeof(cl_uint), (void*)&mixdownGroupsCount);
+        logErrorString(ret);
+        ret = clSetKernelArg(mixFinishKernel, 4, sizeof(cl_uint), (void*)&channelsCountArg);
+        logErrorString(ret);
+        ret = clSetKernelArg(mixFinishKernel, 5, mixdownGroupSize * sizeof(DSPSampleType), NULL);
+        logErrorString(ret);
     }
     
-    ~DSPOpenCL()
+    void _uploadMixing()
     {
-        delete [] waveTable;
-        delete [] samples;
-        delete [] cells;
-        delete [] DefferedUpdateGrid;
-        
-        clReleaseDevice(deviceID);
-        clReleaseContext(context);
-        clReleaseCommandQueue(commandQueue);
-        clReleaseMemObject(cellsMemoryObj);
-        clReleaseMemObject(waveTableMemoryObj);
-        clReleaseMemObject(samplesMemoryObj);
+        if (!_isMixing())
+            return;
         
-        clReleaseKernel(cellsKernel);
-        clReleaseKernel(soundKernel);
+        _prepareMixing();
+        if (cellsMode != CellsModeContinuous)
+            return;
+        clEnqueueWriteBuffer(commandQueue, mixWeightsMemoryObj, CL_TRUE, 0, cellsCount * channelsCount * sizeof(cl_float), mixing->getWeights(), 0, NULL, NULL);
+        clEnqueueWriteBuffer(commandQueue, mixOffsetsMemoryObj, CL_TRUE, 0, channelsCount * sizeof(cl_float), mixing->getOffsets(), 0, NULL, NULL);
     }
     
-    bool pause()
+    // every generation of the history slots times the weights of every channel, one batched matrix product per block
+    void _mixChannels(size_t toWrite)
     {
-        isPaused = !isPaused;
+        size_t localWorkSize[2] = { mixdownGroupSize, 1 };
+        size_t globalWorkSize[2] = { mixdownGroupsCount * mixdownGroupSize, toWrite * channelsCount };
+        clEnqueueNDRangeKernel(commandQueue, mixReduceKernel, 2, NULL, globalWorkSize, localWorkSize, 0, NULL, NULL);
+        
+        globalWorkSize[0] = mixdownGroupSize;
+        clEnqueueNDRangeKernel(commandQueue, mixFinishKernel, 2, NULL, globalWorkSize, localWorkSize, 0, NULL, NULL);
     }
     
-    DSPSampleType4* getCurrentGridState()
+    // matrix swaps happen here, on the processing thread that reads it
+    void _applyMixing()
     {
-        return &cells[0];
+        std::lock_guard<std::mutex> lock(mixingMutex);
+        if (mixingPending == NULL)
+            return;
+        
+        std::swap(mixing, mixingPending);
+        delete mixingPending;
+        mixingPending = NULL;
+        _uploadMixing();
     }
     
-    glm::ivec2 getGridSize()
+    bool _isMixing()
     {
-        return glm::ivec2(gridSize.s[0], gridSize.s[1]);
+        return !mixing->isMean() && !_isBinaryMode();
     }
     
-    size_t getCellsCount()
+    //! `false` while the output is the mono mixdown itself.
+    bool _hasFrames()
     {
-        return cellsCount;
+        return channelsCount > 1 || !mixing->isMean();
     }
     
-    void generateSamples(float* data = NULL)
+    // interleaved frames of the generations of this block, the device ones read back, the mono mixdown spread over every channel without a matrix
+    void _readFrames(size_t generations)
     {
-        if (isPaused)
+        if (!_hasFrames())
             return;
         
-        size_t toWrite = _getBufferToWrite();
-        
-        if (toWrite <= 0)
+        if (!_isMixing())
+        {
+            _readGenerations(0, generations, samples);
+            for (size_t g = generations; g-- > 0;)
+                std::fill(&mixFrames[g * channelsCount], &mixFrames[(g + 1) * channelsCount], samples[g]);
             return;
+        }
         
-        clEnqueueWriteBuffer(commandQueue, rulesMemoryObject, CL_TRUE, 0, rulesMemoryLength * sizeof(cl_float), rules, 0, NULL, NULL);
-        _applyDefferedUpdateGrid();
+        if (cellsMode == CellsModeContinuous && !isReplaying)
+            clEnqueueReadBuffer(commandQueue, mixFramesMemoryObj, CL_TRUE, 0, generations * channelsCount * sizeof(DSPSampleType), mixFrames.data(), 0, NULL, NULL);
+    }
+    
+    void _prepareCycleDetector()
+    {
+        // device binary mode never sees single generations on the host
+        cycleDetector = NULL;
+        isReplaying = false;
+        for (size_t i = 0; i < rulesMemoryLength; ++i)
+            cycleRules[i] = rules[i];
         
-        _updateSamplesProcessed();
-        _updateSamplesToWrite(toWrite);
-
-        size_t globalWorkSize[1] = { cellsCount };
-        clEnqueueNDRangeKernel(commandQueue, cellsKernel, 1, NULL, globalWorkSize, NULL, 0, NULL, NULL);
+        if (cellsMode == CellsModeContinuous || cellsMode == CellsModeContinuousHost)
+        {
+            cycleState.resize(cellsCount * sizeof(cl_float));
+            cycleFirstState.resize(cycleState.size());
+        }
+        else if (cellsMode == CellsModeBinaryHost)
+            cycleState.resize(bitGrid->getWordsCount() * sizeof(uint64_t));
+        else
+            return;
         
-        globalWorkSize[0] = toWrite;
-        clEnqueueNDRangeKernel(commandQueue, soundKernel, 1, NULL, globalWorkSize, NULL, 0, NULL, NULL);
+        cycleDetector = new CycleDetector(cycleState.size());
+    }
+    
+    void _prepareBinaryMemory()
+    {
+        cl_int ret = 0;
+        bitGrid = new BitGrid(gridSize.s[0], gridSize.s[1]);
+        bitCurrent = 0;
+        for (size_t i = 0; i < cellsCount; ++i)
+            cells[i].s[0] = cells[i].s[0] > 0.5f ? 1.0f : 0.0f;
         
-#if LOGENABLED
-        bool logHard = false;
-        if (logHard)
+        if (cellsMode != CellsModeBinary)
         {
-            clEnqueueReadBuffer(commandQueue, samplesMemoryObj, CL_TRUE, 0, toWrite * sizeof(DSPSampleType), samples, 0, NULL, NULL);
-            
-            int tail = toWrite;
-            int radius = 10;
-            
-            for(int i = 0; i < radius; ++i)
-            {
-                std::cerr << i << " " << samples[i] << std::endl;
-            }
-            for(int i = tail - radius; i < tail; ++i)
-            {
-                std::cerr << i << " " << samples[i] << std::endl;
-            }
+            _packBinaryGrid();
+            return;
         }
-#endif
         
-        if (data != NULL)
+        // BitGrid 64-bit words are read as pairs of 32-bit words by BitCells.ncl
+        bitWordsGrid = { gridSize.s[0], (cl_uint)(bitGrid->getWordsPerRow() * 2) };
+        size_t bitCellsLength = bitGrid->getWordsCount() * sizeof(uint64_t);
+        for (int i = 0; i < 2; ++i)
         {
-            clEnqueueReadBuffer(commandQueue, samplesMemoryObj, CL_TRUE, 0, toWrite * sizeof(DSPSampleType), data, 0, NULL, NULL);
-            samplesProcessed += toWrite;
+            bitCellsMemoryObj[i] = clCreateBuffer(context, CL_MEM_READ_WRITE, bitCellsLength, NULL, &ret);
+            logErrorString(ret);
         }
-        else
-        {
-#if UNSAFEBUFFER
-        DSPSampleType* firstPart = nullptr;
-        DSPSampleType* secondPart = nullptr;
-        size_t firstLength = 0;
-        size_t secondLength = 0;
         
-        RingBuffer.getUnsafeDataWritePointer(toWrite, firstPart, secondPart, firstLength, secondLength);
-        if (firstPart != nullptr)
+        std::vector<cl_uint> counts(bufferSize, 0);
+        bitCountsMemoryObj = clCreateBuffer(context, CL_MEM_READ_WRITE, bufferSize * sizeof(cl_uint), NULL, &ret);
+        logErrorString(ret);
+        ret = clEnqueueWriteBuffer(commandQueue, bitCountsMemoryObj, CL_TRUE, 0, bufferSize * sizeof(cl_uint), counts.data(), 0, NULL, NULL);
+        logErrorString(ret);
+        
+        cl_uint bitCellsCount = (cl_uint)bitGrid->getCellsCount();
+        ret = clSetKernelArg(bitStepKernel, 2, sizeof(cl_uint2), (void*)&bitWordsGrid);
+        logErrorString(ret);
+        ret = clSetKernelArg(bitStepKernel, 5, sizeof(cl_mem), (void*)&bitCountsMemoryObj);
+        logErrorString(ret);
+        ret = clSetKernelArg(bitStepKernel, 7, bitStepGroupSize * sizeof(cl_uint), NULL);
+        logErrorString(ret);
+        ret = clSetKernelArg(bitMixdownKernel, 0, sizeof(cl_mem), (void*)&samplesMemoryObj);
+        logErrorString(ret);
+        ret = clSetKernelArg(bitMixdownKernel, 1, sizeof(cl_mem), (void*)&bitCountsMemoryObj);
+        logErrorString(ret);
+        ret = clSetKernelArg(bitMixdownKernel, 2, sizeof(cl_uint), (void*)&bitCellsCount);
+        logErrorString(ret);
+        
+        _packBinaryGrid();
+    }
+    
+    // device buffers and kernels of the wide neighbourhoods, made the first time one is set
+    void _prepareConvolution()
+    {
+        cl_int ret = 0;
+        if (isConvolutionPrepared || cellsMode != CellsModeContinuous)
+            return;
+        
+        _prepareKernels("Convolution.ncl", { { &convolutionLoadKernel, "loadMain" }, { &convolutionPassKernel, "fftPassMain" }, { &convolutionMultiplyKernel, "multiplyMain" }, { &convolutionApplyKernel, "applyMain" }, { &windowRowsKernel, "rowSumMain" }, { &windowColumnsKernel, "columnSumMain" } });
+        isConvolutionPrepared = true;
+        
+        for (int i = 0; i < 2; ++i)
+        {
+            convolutionMemoryObj[i] = clCreateBuffer(context, CL_MEM_READ_WRITE, cellsCount * sizeof(cl_float2), NULL, &ret);
+            logErrorString(ret);
+        }
+        convolutionSpectrumMemoryObj = clCreateBuffer(context, CL_MEM_READ_ONLY, cellsCount * sizeof(cl_float2), NULL, &ret);
+        logErrorString(ret);
+        
+        ret = clSetKernelArg(convolutionLoadKernel, 0, sizeof(cl_mem), (void*)&cellsMemoryObj);
+        logErrorString(ret);
+        ret = clSetKernelArg(convolutionLoadKernel, 2, sizeof(cl_mem), (void*)&convolutionMemoryObj[0]);
+        logErrorString(ret);
+        ret = clSetKernelArg(convolutionMultiplyKernel, 1, sizeof(cl_mem), (void*)&convolutionSpectrumMemoryObj);
+        logErrorString(ret);
+        ret = clSetKernelArg(convolutionApplyKernel, 0, sizeof(cl_mem), (void*)&cellsMemoryObj);
+        logErrorString(ret);
+        ret = clSetKernelArg(convolutionApplyKernel, 2, sizeof(cl_mem), (void*)&rulesMemoryObject);
+        logErrorString(ret);
+        ret = clSetKernelArg(convolutionApplyKernel, 3, sizeof(cl_mem), (void*)&ruleTableMemoryObj);
+        logErrorString(ret);
+        
+        ret = clSetKernelArg(windowRowsKernel, 0, sizeof(cl_mem), (void*)&cellsMemoryObj);
+        logErrorString(ret);
+        ret = clSetKernelArg(windowRowsKernel, 2, sizeof(cl_mem), (void*)&convolutionMemoryObj[0]);
+        logErrorString(ret);
+        ret = clSetKernelArg(windowRowsKernel, 3, sizeof(cl_uint2), (void*)&gridSize);
+        logErrorString(ret);
+        ret = clSetKernelArg(windowColumnsKernel, 0, sizeof(cl_mem), (void*)&convolutionMemoryObj[0]);
+        logErrorString(ret);
+        ret = clSetKernelArg(windowColumnsKernel, 1, sizeof(cl_mem), (void*)&convolutionMemoryObj[1]);
+        logErrorString(ret);
+        ret = clSetKernelArg(windowColumnsKernel, 2, sizeof(cl_uint2), (void*)&gridSize);
+        logErrorString(ret);
+    }
+    
+    void _packBinaryGrid()
+    {
+        for (cl_uint x = 0; x < gridSize.s[0]; ++x)
+            for (cl_uint y = 0; y < gridSize.s[1]; ++y)
+                bitGrid->set(x, y, cells[x * gridSize.s[1] + y].s[0] > 0.5f);
+        
+        if (cellsMode == CellsModeBinary)
+            clEnqueueWriteBuffer(commandQueue, bitCellsMemoryObj[bitCurrent], CL_TRUE, 0, bitGrid->getWordsCount() * sizeof(uint64_t), bitGrid->getWords(), 0, NULL, NULL);
+    }
+    
+    void _unpackBinaryGrid()
+    {
+        if (cellsMode == CellsModeBinary)
+            clEnqueueReadBuffer(commandQueue, bitCellsMemoryObj[bitCurrent], CL_TRUE, 0, bitGrid->getWordsCount() * sizeof(uint64_t), bitGrid->getWords(), 0, NULL, NULL);
+        
+        for (cl_uint x = 0; x < gridSize.s[0]; ++x)
+            for (cl_uint y = 0; y < gridSize.s[1]; ++y)
+                cells[x * gridSize.s[1] + y].s[0] = bitGrid->get(x, y) ? 1.0f : 0.0f;
+    }
+
+    
+    // Cells.ncl counts generations, which only match samples without control rate stepping
+    void _updateSamplesProcessed()
+    {
+        clSetKernelArg(cellsKernel, 3, sizeof(cl_uint), (void*)&generationsProcessed);
+        clSetKernelArg(soundKernel, 3, sizeof(cl_uint), (void*)&samplesProcessed);
+    }
+    
+    void _updateSamplesToWrite(size_t newValue)
+    {
+        // Cells.ncl cycles through samplesToWrite slots, quiet tiles only know the slots of the old count hold their state
+        if (samplesToWrite != (cl_uint)newValue)
+            isTilesDirty = true;
+        samplesToWrite = (cl_uint)newValue;
+        clSetKernelArg(cellsKernel, 4, sizeof(cl_uint), (void*)&samplesToWrite);
+        clSetKernelArg(soundKernel, 4, sizeof(cl_uint), (void*)&samplesToWrite);
+    }
+    
+    static cl_uint _ruleTableSumLevels(cl_uint levels)
+    {
+        return ruleNeighboursCount * (levels - 1) + 1;
+    }
+    
+    static float _quantize(float value, cl_uint levels)
+    {
+        float scale = (float)(levels - 1);
+        return floorf(value * scale + 0.5f) / scale;
+    }
+    
+    float _ruleNextState(float state, float sum, float deltaValue)
+    {
+        return cellsRuleNextState(rules, state, sum, deltaValue);
+    }
+    
+    float _ruleNextState(float state, float sum)
+    {
+        return cellsRuleNextState(rules, state, sum, cellsRuleDelta(rules));
+    }
+    
+    // binary modes read the rules with delta 1, or a custom two state table
+    void _updateBinaryRule()
+    {
+        cl_uint sumLevels = _ruleTableSumLevels(2);
+        bool fromTable = isRuleTableCustom && ruleTableLevels == 2;
+        binaryRule = BinaryRule(0, 0);
+        for (cl_uint n = 0; n < sumLevels; ++n)
+        {
+            float born = fromTable ? ruleTable[n] : _ruleNextState(0.0f, (float)n, 1.0f);
+            float kept = fromTable ? ruleTable[sumLevels + n] : _ruleNextState(1.0f, (float)n, 1.0f);
+            binaryRule.birthMask |= (born > 0.5f ? 1u : 0u) << n;
+            binaryRule.keepMask |= (kept > 0.5f ? 1u : 0u) << n;
+        }
+    }
+    
+    bool _rulesChanged()
+    {
+        bool changed = false;
+        for (size_t i = 0; i < rulesMemoryLength; ++i)
+        {
+            changed |= ruleTableRules[i] != rules[i];
+            ruleTableRules[i] = rules[i];
+        }
+        return changed;
+    }
+    
+    void _uploadRuleTable(cl_uint levels)
+    {
+        ruleTableLevels = levels;
+        if (levels > 0)
+            clEnqueueWriteBuffer(commandQueue, ruleTableMemoryObj, CL_TRUE, 0, levels * _ruleTableSumLevels(levels) * sizeof(cl_float), ruleTable, 0, NULL, NULL);
+        clSetKernelArg(cellsKernel, 9, sizeof(cl_uint), (void*)&ruleTableLevels);
+        clSetKernelArg(soundKernel, 9, sizeof(cl_uint), (void*)&ruleTableLevels);
+        isTilesDirty = true;
+        if (cellsCPU)
+            cellsCPU->touch();
+    }
+    
+    void _updateRuleTable()
+    {
+        bool changed = _rulesChanged();
+        if (isRuleTableCustom)
+            return;
+        
+        if (!isQuantized)
+        {
+            if (ruleTableLevels != 0)
+                _uploadRuleTable(0);
+            return;
+        }
+        
+        // with delta = 1 / 2^speed the states form 2^speed + 1 levels and the neighbour sum is a multiple of delta
+        float speed = fminf(fmaxf(floorf(rules[4]), 0.0f), 16.0f);
+        cl_uint levels = (1u << (cl_uint)speed) + 1;
+        cl_uint sumLevels = _ruleTableSumLevels(levels);
+        if ((size_t)levels * sumLevels > ruleTableMaxLength)
+        {
+            // too fine for a table, kernels fall back to the arithmetic rule
+            if (ruleTableLevels != 0)
+                _uploadRuleTable(0);
+            return;
+        }
+        
+        if (!changed && levels == ruleTableLevels)
+            return;
+        
+        for (cl_uint state = 0; state < levels; ++state)
+        {
+            for (cl_uint sum = 0; sum < sumLevels; ++sum)
+            {
+                ruleTable[state * sumLevels + sum] = _ruleNextState((float)state / (levels - 1), (float)sum / (levels - 1));
+            }
+        }
+        _uploadRuleTable(levels);
+        
+#if LOGENABLED
+        std::cout << "[Rules]: table rebuilt, " << levels << " states x " << sumLevels << " sums" << std::endl;
+#endif
+    }
+    
+    void _applyDefferedUpdateGrid()
+    {
+        bool edited = false;
+        for (int i = 0; i < cellsCount; ++i)
+        {
+            float replaceMask = DefferedUpdateGrid[i].s[0] > 0.0f ? 1.0f : 0.0f;
+            float clearMask = DefferedUpdateGrid[i].s[0] < 0.0f ? 1.0f : 0.0f;
+            edited |= replaceMask + clearMask > 0.0f;
+            
+#if LOGENABLED
+            bool log = false;
+            if (replaceMask == 1.0)
+            {
+                log = true;
+                std::cout << "[Cells]: Replaced[" << i << "]" << std::endl;
+            }
+            if (clearMask == 1.0)
+            {
+                log = true;
+                std::cout << "[Cells]: Cleared[" << i << "]" << std::endl;
+            }
+#endif
+            for (int j = 0; j < 4; ++j)
+            {
+                cells[i].s[j] = (replaceMask * DefferedUpdateGrid[i].s[j] + (1.0f - replaceMask) * cells[i].s[j]) * (1.0f - clearMask);
+                DefferedUpdateGrid[i].s[j] = 0.0f;
+#if LOGENABLED
+                if (log)
+                    std::cout << "[Cells]: New value[" << i << "][" << j << "] = " << cells[i].s[j] << std::endl;
+#endif
+            }
+            if (ruleTableLevels > 0)
+                cells[i].s[0] = _quantize(cells[i].s[0], ruleTableLevels);
+        }
+        
+        if (cellsMode != CellsModeContinuous)
+        {
+            if (edited)
+                _uploadCells();
+            return;
+        }
+        
+        if (edited)
+            isTilesDirty = true;
+        clEnqueueWriteBuffer(commandQueue, cellsMemoryObj, CL_TRUE, 0, cellsCount * sizeof(DSPSampleType4), cells, 0, NULL, NULL);
+    }
+    
+    // pushes host cells into whatever holds the live grid of the current mode
+    void _uploadCells()
+    {
+        switch (cellsMode)
+        {
+            case CellsModeBinary:
+            case CellsModeBinaryHost:
+                _packBinaryGrid();
+                break;
+            case CellsModeContinuousHost:
+                cellsCPU->load(&cells[0].s[0], 4);
+                break;
+            default:
+                isTilesDirty = true;
+                clEnqueueWriteBuffer(commandQueue, cellsMemoryObj, CL_TRUE, 0, cellsCount * sizeof(DSPSampleType4), cells, 0, NULL, NULL);
+                break;
+        }
+    }
+    
+    // a new seed replaces the whole grid, the device fills its first history slot itself
+    void _applySeed()
+    {
+        if (!isSeedDirty)
+            return;
+        
+        seed = pendingSeed;
+        isSeedDirty = false;
+        _invalidateCycle();
+        if (cellsMode != CellsModeContinuous)
+        {
+            for (size_t i = 0; i < cellsCount; ++i)
+                cells[i].s[0] = philoxCellUniform(seed, (uint32_t)i);
+            _uploadCells();
+            return;
+        }
+        
+        cl_uint2 key = { (cl_uint)seed, (cl_uint)(seed >> 32) };
+        cl_uint cellsCountArg = (cl_uint)cellsCount;
+        cl_uint stream = PhiloxStreamState;
+        cl_uint epoch = 0;
+        clSetKernelArg(seedKernel, 0, sizeof(cl_mem), (void*)&cellsMemoryObj);
+        clSetKernelArg(seedKernel, 1, sizeof(cl_uint2), (void*)&key);
+        clSetKernelArg(seedKernel, 2, sizeof(cl_uint), (void*)&cellsCountArg);
+        clSetKernelArg(seedKernel, 3, sizeof(cl_uint), (void*)&stream);
+        clSetKernelArg(seedKernel, 4, sizeof(cl_uint), (void*)&epoch);
+        size_t globalWorkSize[1] = { cellsCount };
+        clEnqueueNDRangeKernel(commandQueue, seedKernel, 1, NULL, globalWorkSize, NULL, 0, NULL, NULL);
+        clEnqueueReadBuffer(commandQueue, cellsMemoryObj, CL_TRUE, 0, cellsCount * sizeof(DSPSampleType4), cells, 0, NULL, NULL);
+    }
+    
+    void _applyBoundary(BoundaryMode mode, cl_float value)
+    {
+        boundaryMode = mode;
+        boundaryValue = value;
+        clSetKernelArg(cellsKernel, 13, sizeof(cl_uint), (void*)&boundaryMode);
+        clSetKernelArg(cellsKernel, 14, sizeof(cl_float), (void*)&boundaryValue);
+        if (cellsCPU)
+            cellsCPU->setBoundary(mode, value);
+        _invalidateCycle();
+    }
+    
+    // buffers, kernel arguments and the host automaton only change between blocks, on the thread that computes them
+    void _applySettings()
+    {
+        std::lock_guard<std::mutex> lock(settingsMutex);
+        if (isQuantizedDirty)
+        {
+            isQuantized = pendingQuantized;
+            ruleTableRules[0] = NAN;
+            _invalidateCycle();
+            isQuantizedDirty = false;
+        }
+        if (isCycleDetectionDirty)
+        {
+            isCycleDetectionEnabled = pendingCycleDetection;
+            _invalidateCycle();
+            isCycleDetectionDirty = false;
+        }
+        if (isBoundaryDirty)
+        {
+            _applyBoundary((BoundaryMode)pendingBoundaryMode, pendingBoundaryValue);
+            isBoundaryDirty = false;
+        }
+        if (isNeighbourhoodDirty)
+        {
+            if (!pendingNeighbourhood.isStencil())
+                _prepareConvolution();
+            neighbourhood = pendingNeighbourhood;
+            if (cellsCPU)
+                cellsCPU->setNeighbourhood(neighbourhood);
+            isNeighbourhoodDirty = false;
+        }
+        if (isConvolutionDirty)
+        {
+            if (pendingConvolutionEnabled)
+            {
+                if (!convolution)
+                    convolution = new ConvolutionCPU(gridSize.s[0], gridSize.s[1]);
+                _prepareConvolution();
+                if (convolution->setKernel(pendingConvolutionKernel, (float)ruleNeighboursCount) && cellsMode == CellsModeContinuous)
+                    clEnqueueWriteBuffer(commandQueue, convolutionSpectrumMemoryObj, CL_TRUE, 0, cellsCount * sizeof(cl_float2), convolution->getSpectrum(), 0, NULL, NULL);
+            }
+            if (cellsCPU)
+                cellsCPU->setConvolution(pendingConvolutionEnabled ? convolution : NULL);
+            isConvolutionEnabled = pendingConvolutionEnabled;
+            _invalidateCycle();
+            isConvolutionDirty = false;
+        }
+    }
+    
+    bool _canFastForward()
+    {
+        return !isConvolutionEnabled && neighbourhood.isStencil() && boundaryMode == BoundaryTorus && HashLife::supportsSize(gridSize.s[0], gridSize.s[1]);
+    }
+    
+    // host cells hold the grid between blocks, the jump replaces it before the block computes anything
+    void _applyFastForward()
+    {
+        if (!isFastForwardDirty)
+            return;
+        
+        isFastForwardDirty = false;
+        if (!_canFastForward())
+            return;
+        
+        if (!hashLife)
+            hashLife = new HashLife();
+        
+        _updateBinaryRule();
+        hashLife->setRule(binaryRule);
+        
+        // continuous mode keeps the next generation in the first history slot
+        size_t height = gridSize.s[1];
+        hashLife->load(height, [this, height](uint32_t x, uint32_t y) { return cells[x * height + y].s[0] > 0.5f; });
+        hashLife->advance(fastForwardPendingLog2);
+        hashLife->store([this, height](uint32_t x, uint32_t y, bool alive) { cells[x * height + y].s[0] = alive ? 1.0f : 0.0f; });
+        _invalidateCycle();
+        
+#if LOGENABLED
+        std::cout << "[Cells]: fast forward " << (1ull << fastForwardPendingLog2) << " generations, " << hashLife->getNodesCount() << " nodes" << std::endl;
+#endif
+        
+        _uploadCells();
+    }
+    
+    // saves copy the host grid into the staging slot and write it off the audio thread, a restore uploads straight
+    // from the mapped file
+    void _applySnapshots()
+    {
+        std::vector<std::string> savePaths;
+        std::shared_ptr<SnapshotFile> restore;
+        {
+            std::lock_guard<std::mutex> lock(snapshotMutex);
+            // the writer still holds the slot of the last save, new saves wait for a later block
+            if (snapshotStaging.use_count() == 1)
+                savePaths.swap(snapshotSavePaths);
+            restore.swap(snapshotPending);
+        }
+        
+        if (!savePaths.empty())
+        {
+            // the writer let go of the slot, its reads are done before the copy below
+            std::atomic_thread_fence(std::memory_order_acquire);
+            SnapshotHeader header;
+            header.width = gridSize.s[0];
+            header.height = gridSize.s[1];
+            header.cellsMode = cellsMode;
+            header.componentBytes = sizeof(DSPSampleType);
+            header.componentsCount = 4;
+            header.boundaryMode = boundaryMode;
+            header.boundaryValue = boundaryValue;
+            std::copy(rules, rules + 5, header.rules);
+            header.generation = generationsProcessed;
+            header.seed = seed;
+            
+            std::copy(cells, cells + cellsCount, snapshotStaging->begin());
+            for (const std::string& path : savePaths)
+                snapshotWriter.write(path, header, std::shared_ptr<const void>(snapshotStaging, snapshotStaging->data()));
+        }
+        
+        if (!restore)
+            return;
+        
+        const SnapshotHeader& header = restore->getHeader();
+        const DSPSampleType4* plane = (const DSPSampleType4*)restore->getPlane(0);
+        std::copy(header.rules, header.rules + 5, rules);
+        seed = pendingSeed = header.seed;
+        isSeedDirty = false;
+        generationsProcessed = (cl_uint)header.generation;
+        _applyBoundary((BoundaryMode)header.boundaryMode, header.boundaryValue);
+        std::copy(plane, plane + cellsCount, cells);
+        _invalidateCycle();
+        if (cellsMode == CellsModeContinuous)
+            clEnqueueWriteBuffer(commandQueue, cellsMemoryObj, CL_TRUE, 0, cellsCount * sizeof(DSPSampleType4), plane, 0, NULL, NULL);
+        else
+            _uploadCells();
+    }
+    
+    bool _hasDefferedUpdates()
+    {
+        for (size_t i = 0; i < cellsCount; ++i)
+        {
+            if (DefferedUpdateGrid[i].s[0] != 0.0f)
+                return true;
+        }
+        return false;
+    }
+    
+    // host cells already hold the replayed state, so leaving replay is just a reset
+    void _invalidateCycle()
+    {
+        isTilesDirty = true;
+        if (cycleDetector == NULL)
+            return;
+        
+#if LOGENABLED
+        if (cycleDetector->isLocked())
+            std::cout << "[Cycle]: invalidated" << std::endl;
+#endif
+        cycleDetector->reset();
+    }
+    
+    void _checkCycleInvalidation()
+    {
+        bool changed = false;
+        for (size_t i = 0; i < rulesMemoryLength; ++i)
+        {
+            changed |= cycleRules[i] != rules[i];
+            cycleRules[i] = rules[i];
+        }
+        
+        if (changed || _hasDefferedUpdates())
+            _invalidateCycle();
+    }
+    
+    void _extractCycleState(size_t slot, std::vector<uint8_t>& target)
+    {
+        cl_float* plane = (cl_float*)target.data();
+        for (size_t i = 0; i < cellsCount; ++i)
+            plane[i] = cells[slot * cellsCount + i].s[0];
+    }
+    
+    // continuous mode: generation of sample 0 was captured before the kernels overwrote slot 0
+    void _trackContinuousCycle(size_t toWrite)
+    {
+        if (cycleDetector == NULL || !isCycleDetectionEnabled)
+            return;
+        
+        _readGenerations(0, toWrite, samples);
+        for (size_t sampleIdx = 0; sampleIdx < toWrite; ++sampleIdx)
+        {
+            if (sampleIdx > 0)
+                _extractCycleState(sampleIdx, cycleState);
+            cycleDetector->push(sampleIdx > 0 ? cycleState.data() : cycleFirstState.data(), samples[sampleIdx]);
+        }
+        
+#if LOGENABLED
+        if (cycleDetector->isLocked())
+            std::cout << "[Cycle]: period " << cycleDetector->getPeriod() << " found" << std::endl;
+#endif
+    }
+    
+    void _processBinaryHost(size_t toWrite)
+    {
+        bool track = cycleDetector != NULL && isCycleDetectionEnabled;
+        float scale = 2.0f / (float)bitGrid->getCellsCount();
+        for (size_t sampleIdx = 0; sampleIdx < toWrite; ++sampleIdx)
+        {
+            if (track)
+                std::memcpy(cycleState.data(), bitGrid->getWords(), cycleState.size());
+            samples[sampleIdx] = (float)bitGrid->step(binaryRule) * scale - 1.0f;
+            if (track)
+                cycleDetector->push(cycleState.data(), samples[sampleIdx]);
+        }
+    }
+    
+    // compute stays idle, the cached period is played and its state published for drawing
+    void _processReplay(size_t toWrite)
+    {
+        if (_isMixing())
+        {
+            // the replayed states go through the matrix on the host
+            for (size_t g = 0; g < toWrite; ++g)
+            {
+                mixing->mix((const cl_float*)cycleDetector->getReplayState(), &mixFrames[g * channelsCount]);
+                cycleDetector->replay(&samples[g], 1);
+            }
+        }
+        else
+            cycleDetector->replay(samples, toWrite);
+        
+        const void* state = cycleDetector->getReplayState();
+        if (cellsMode == CellsModeContinuousHost)
+            cellsCPU->load((const cl_float*)state);
+        if (cellsMode == CellsModeBinaryHost)
+        {
+            std::memcpy(bitGrid->getWords(), state, cycleState.size());
+            for (cl_uint x = 0; x < gridSize.s[0]; ++x)
+                for (cl_uint y = 0; y < gridSize.s[1]; ++y)
+                    cells[x * gridSize.s[1] + y].s[0] = bitGrid->get(x, y) ? 1.0f : 0.0f;
+            return;
+        }
+        
+        const cl_float* plane = (const cl_float*)state;
+        for (size_t i = 0; i < cellsCount; ++i)
+            cells[i].s[0] = plane[i];
+    }
+    
+    // pool swaps happen here, on the processing thread that uses it
+    void _applyTemporalBlocking()
+    {
+        if (!isCellsBlockingDirty)
+            return;
+        
+        if (cellsThreadPool == NULL || (cellsBlockThreads != 0 && cellsBlockThreads != cellsThreadPool->getThreadsCount()))
+        {
+            delete cellsThreadPool;
+            cellsThreadPool = new ThreadPool(cellsBlockThreads);
+        }
+        cellsCPU->setTemporalBlocking(cellsBlockGenerations, cellsThreadPool);
+        isCellsBlockingDirty = false;
+    }
+    
+    void _processContinuousHost(size_t toWrite)
+    {
+        _applyTemporalBlocking();
+        cellsCPU->setRules(rules);
+        cellsCPU->setRuleTable(ruleTableLevels, ruleTable);
+        
+        bool track = cycleDetector != NULL && isCycleDetectionEnabled;
+        bool mix = _isMixing();
+        if (!track && !controlRate.needsBands() && !mix)
+        {
+            // nothing needs the generations in between, so they may be advanced in temporal blocks
+            cellsCPU->render(samples, toWrite);
+            return;
+        }
+        
+        float scale = 2.0f / (float)cellsCount;
+        float sum = cellsCPU->getSum();
+        for (size_t sampleIdx = 0; sampleIdx < toWrite; ++sampleIdx)
+        {
+            samples[sampleIdx] = sum * scale - 1.0f;
+            if (track)
+            {
+                cellsCPU->copyState((cl_float*)cycleState.data());
+                cycleDetector->push(cycleState.data(), samples[sampleIdx]);
+            }
+            if (controlRate.needsBands())
+            {
+                cellsCPU->copyState(controlPlane.data());
+                _bandsFromPlane(controlPlane.data(), 1, &controlBands[sampleIdx * controlRate.getBandsCount()]);
+            }
+            if (mix)
+            {
+                cellsCPU->copyState(mixPlane.data());
+                mixing->mix(mixPlane.data(), &mixFrames[sampleIdx * channelsCount]);
+            }
+            sum = cellsCPU->step();
+        }
+    }
+    
+    // every tile counts as changed before the first generation of the block, none trusts the slots it holds,
+    // and the tile sums of slot 0 are taken from the cells
+    void _resetTiles()
+    {
+        if (!isTilesDirty)
+            return;
+        
+        size_t tilesCount = tilesGrid.s[0] * tilesGrid.s[1];
+        std::vector<cl_uint> flags(2 * tilesCount, 1);
+        clEnqueueWriteBuffer(commandQueue, tileChangedMemoryObj, CL_TRUE, 0, flags.size() * sizeof(cl_uint), flags.data(), 0, NULL, NULL);
+        std::fill(flags.begin(), flags.end(), 0);
+        clEnqueueWriteBuffer(commandQueue, tileQuietRunsMemoryObj, CL_TRUE, 0, tilesCount * sizeof(cl_uint), flags.data(), 0, NULL, NULL);
+        
+        size_t localWorkSize[1] = { cellsTileSize * cellsTileSize };
+        size_t globalWorkSize[1] = { tilesCount * localWorkSize[0] };
+        clEnqueueNDRangeKernel(commandQueue, tileSumsKernel, 1, NULL, globalWorkSize, localWorkSize, 0, NULL, NULL);
+        isTilesDirty = false;
+    }
+    
+    void _processContinuous(size_t toWrite)
+    {
+        // the wide passes keep no tile data, it is rebuilt once the stencil runs again
+        if (isConvolutionEnabled)
+        {
+            _processConvolution(toWrite);
+            isTilesDirty = true;
+            return;
+        }
+        if (!neighbourhood.isStencil())
+        {
+            _processWindowed(toWrite);
+            isTilesDirty = true;
+            return;
+        }
+        
+        _resetTiles();
+
+        // one launch per generation, so every work group sees the whole previous generation, one work group per tile
+        size_t localWorkSize[1] = { cellsTileSize * cellsTileSize };
+        size_t globalWorkSize[1] = { tilesGrid.s[0] * tilesGrid.s[1] * localWorkSize[0] };
+        for (cl_uint sampleIdx = 0; sampleIdx < toWrite; ++sampleIdx)
+        {
+            clSetKernelArg(cellsKernel, 16, sizeof(cl_uint), (void*)&sampleIdx);
+            clEnqueueNDRangeKernel(commandQueue, cellsKernel, 1, NULL, globalWorkSize, localWorkSize, 0, NULL, NULL);
+        }
+        
+        _mixdown(toWrite, true);
+    }
+    
+    // rows run along y and are contiguous, columns run along x one row apart
+    void _convolutionFFT(size_t& current, cl_float direction)
+    {
+        cl_uint axes[2][3] = { { gridSize.s[1], 1, gridSize.s[1] }, { gridSize.s[0], gridSize.s[1], 1 } };
+        size_t lines[2] = { gridSize.s[0], gridSize.s[1] };
+        clSetKernelArg(convolutionPassKernel, 5, sizeof(cl_float), (void*)&direction);
+        for (int axis = 0; axis < 2; ++axis)
+        {
+            size_t globalWorkSize[2] = { axes[axis][0] / 2, lines[axis] };
+            clSetKernelArg(convolutionPassKernel, 3, sizeof(cl_uint), (void*)&axes[axis][1]);
+            clSetKernelArg(convolutionPassKernel, 4, sizeof(cl_uint), (void*)&axes[axis][2]);
+            for (cl_uint p = 1; p < axes[axis][0]; p <<= 1)
+            {
+                clSetKernelArg(convolutionPassKernel, 0, sizeof(cl_mem), (void*)&convolutionMemoryObj[current]);
+                clSetKernelArg(convolutionPassKernel, 1, sizeof(cl_mem), (void*)&convolutionMemoryObj[1 - current]);
+                clSetKernelArg(convolutionPassKernel, 2, sizeof(cl_uint), (void*)&p);
+                clEnqueueNDRangeKernel(commandQueue, convolutionPassKernel, 2, NULL, globalWorkSize, NULL, 0, NULL, NULL);
+                current = 1 - current;
+            }
+        }
+    }
+    
+    // per generation: cells -> spectrum, times the kernel spectrum, back, rules into the next history slot
+    void _processConvolution(size_t toWrite)
+    {
+        size_t globalWorkSize[1] = { cellsCount };
+        clSetKernelArg(convolutionApplyKernel, 4, sizeof(cl_uint), (void*)&ruleTableLevels);
+        clSetKernelArg(convolutionApplyKernel, 6, sizeof(cl_uint), (void*)&samplesToWrite);
+        for (cl_uint sampleIdx = 0; sampleIdx < toWrite; ++sampleIdx)
+        {
+            size_t current = 0;
+            clSetKernelArg(convolutionLoadKernel, 1, sizeof(cl_uint), (void*)&sampleIdx);
+            clEnqueueNDRangeKernel(commandQueue, convolutionLoadKernel, 1, NULL, globalWorkSize, NULL, 0, NULL, NULL);
+            
+            _convolutionFFT(current, -1.0f);
+            clSetKernelArg(convolutionMultiplyKernel, 0, sizeof(cl_mem), (void*)&convolutionMemoryObj[current]);
+            clEnqueueNDRangeKernel(commandQueue, convolutionMultiplyKernel, 1, NULL, globalWorkSize, NULL, 0, NULL, NULL);
+            _convolutionFFT(current, 1.0f);
+            
+            clSetKernelArg(convolutionApplyKernel, 1, sizeof(cl_mem), (void*)&convolutionMemoryObj[current]);
+            clSetKernelArg(convolutionApplyKernel, 5, sizeof(cl_uint), (void*)&sampleIdx);
+            clEnqueueNDRangeKernel(commandQueue, convolutionApplyKernel, 1, NULL, globalWorkSize, NULL, 0, NULL, NULL);
+        }
+        
+        _mixdown(toWrite);
+    }
+    
+    // per generation: running sums along the rows, then along the columns, rules into the next history slot
+    void _processWindowed(size_t toWrite)
+    {
+        cl_uint radius = WindowSumsCPU::clampRadius(neighbourhood.radius, gridSize.s[0], gridSize.s[1]);
+        cl_uint cross = neighbourhood.shape == NeighbourhoodCross ? 1 : 0;
+        cl_float scale = (cl_float)ruleNeighboursCount / (cl_float)Neighbourhood(neighbourhood.shape, radius).getCellsCount();
+        clSetKernelArg(windowRowsKernel, 4, sizeof(cl_uint), (void*)&radius);
+        clSetKernelArg(windowColumnsKernel, 3, sizeof(cl_uint), (void*)&radius);
+        clSetKernelArg(windowColumnsKernel, 4, sizeof(cl_uint), (void*)&cross);
+        clSetKernelArg(windowColumnsKernel, 5, sizeof(cl_float), (void*)&scale);
+        clSetKernelArg(convolutionApplyKernel, 1, sizeof(cl_mem), (void*)&convolutionMemoryObj[1]);
+        clSetKernelArg(convolutionApplyKernel, 4, sizeof(cl_uint), (void*)&ruleTableLevels);
+        clSetKernelArg(convolutionApplyKernel, 6, sizeof(cl_uint), (void*)&samplesToWrite);
+        
+        size_t rowsWorkSize[1] = { gridSize.s[0] };
+        size_t columnsWorkSize[1] = { gridSize.s[1] };
+        size_t cellsWorkSize[1] = { cellsCount };
+        for (cl_uint sampleIdx = 0; sampleIdx < toWrite; ++sampleIdx)
+        {
+            clSetKernelArg(windowRowsKernel, 1, sizeof(cl_uint), (void*)&sampleIdx);
+            clEnqueueNDRangeKernel(commandQueue, windowRowsKernel, 1, NULL, rowsWorkSize, NULL, 0, NULL, NULL);
+            clEnqueueNDRangeKernel(commandQueue, windowColumnsKernel, 1, NULL, columnsWorkSize, NULL, 0, NULL, NULL);
+            clSetKernelArg(convolutionApplyKernel, 5, sizeof(cl_uint), (void*)&sampleIdx);
+            clEnqueueNDRangeKernel(commandQueue, convolutionApplyKernel, 1, NULL, cellsWorkSize, NULL, 0, NULL, NULL);
+        }
+        
+        _mixdown(toWrite);
+    }
+    
+    void _processBinary(size_t toWrite)
+    {
+        // one launch per generation, the step kernel accumulates each generation's popcount
+        size_t wordsCount = bitWordsGrid.s[0] * bitWordsGrid.s[1];
+        size_t globalWorkSize[1] = { (wordsCount + bitStepGroupSize - 1) / bitStepGroupSize * bitStepGroupSize };
+        size_t localWorkSize[1] = { bitStepGroupSize };
+        clSetKernelArg(bitStepKernel, 3, sizeof(cl_uint), (void*)&binaryRule.birthMask);
+        clSetKernelArg(bitStepKernel, 4, sizeof(cl_uint), (void*)&binaryRule.keepMask);
+        for (cl_uint sampleIdx = 0; sampleIdx < toWrite; ++sampleIdx)
+        {
+            clSetKernelArg(bitStepKernel, 0, sizeof(cl_mem), (void*)&bitCellsMemoryObj[bitCurrent]);
+            clSetKernelArg(bitStepKernel, 1, sizeof(cl_mem), (void*)&bitCellsMemoryObj[1 - bitCurrent]);
+            clSetKernelArg(bitStepKernel, 6, sizeof(cl_uint), (void*)&sampleIdx);
+            clEnqueueNDRangeKernel(commandQueue, bitStepKernel, 1, NULL, globalWorkSize, localWorkSize, 0, NULL, NULL);
+            bitCurrent = 1 - bitCurrent;
+        }
+        
+        globalWorkSize[0] = toWrite;
+        clEnqueueNDRangeKernel(commandQueue, bitMixdownKernel, 1, NULL, globalWorkSize, NULL, 0, NULL, NULL);
+    }
+    
+    void _setPendingMixing(MixingMatrix* matrix)
+    {
+        std::lock_guard<std::mutex> lock(mixingMutex);
+        delete mixingPending;
+        mixingPending = matrix;
+    }
+    
+    bool _isBinaryMode()
+    {
+        return cellsMode == CellsModeBinary || cellsMode == CellsModeBinaryHost;
+    }
+    
+    bool _isHostMode()
+    {
+        return cellsMode == CellsModeBinaryHost || cellsMode == CellsModeContinuousHost;
+    }
+    
+    // mean state of each band of rows
+    void _bandsFromPlane(const cl_float* plane, size_t stride, float* target)
+    {
+        size_t bandsCount = controlRate.getBandsCount();
+        size_t height = gridSize.s[1];
+        for (size_t band = 0; band < bandsCount; ++band)
+        {
+            size_t rowBegin = band * gridSize.s[0] / bandsCount;
+            size_t rowEnd = (band + 1) * gridSize.s[0] / bandsCount;
+            float sum = 0.0f;
+            for (size_t i = rowBegin * height; i < rowEnd * height; ++i)
+                sum += plane[i * stride];
+            target[band] = sum / (float)((rowEnd - rowBegin) * height);
+        }
+    }
+    
+    void _applyControlRate()
+    {
+        if (!isControlRateDirty)
+            return;
+        
+        controlRate.setInterval(controlPendingInterval, controlPendingMode);
+        if (controlRate.needsBands())
+        {
+            controlRate.setBands(std::min<size_t>(gridSize.s[0], controlBandsMaxCount), (float)sampleRate);
+            controlBands.resize(bufferSize * controlRate.getBandsCount());
+            controlPlane.resize(cellsCount);
+        }
+        controlOutput.resize(bufferSize * channelsCount);
+        isControlRateDirty = false;
+    }
+    
+    // hands the generations of this block to the control rate renderer and renders the output block
+    void _renderControlRate(size_t generations, size_t toWrite)
+    {
+        if (generations > 0)
+        {
+            _readGenerations(0, generations, samples);
+            const float* bands = NULL;
+            if (controlRate.needsBands() && !isReplaying)
+            {
+                // device history slots hold one generation each
+                if (cellsMode == CellsModeContinuous)
+                    for (size_t g = 0; g < generations; ++g)
+                        _bandsFromPlane(&cells[g * cellsCount].s[0], 4, &controlBands[g * controlRate.getBandsCount()]);
+                bands = controlBands.data();
+            }
+            controlRate.push(_hasFrames() ? mixFrames.data() : samples, generations, bands);
+        }
+        controlRate.render(controlOutput.data(), toWrite);
+    }
+    
+    // interleaved output frames, the rendered control rate block unless every sample is a generation
+    void _readSamples(size_t offset, size_t count, DSPSampleType* target)
+    {
+        if (!controlRate.isPassthrough())
+        {
+            std::memcpy(target, controlOutput.data() + offset * channelsCount, count * channelsCount * sizeof(DSPSampleType));
+            return;
+        }
+        if (_hasFrames())
+        {
+            std::memcpy(target, mixFrames.data() + offset * channelsCount, count * channelsCount * sizeof(DSPSampleType));
+            return;
+        }
+        _readGenerations(offset, count, target);
+    }
+    
+    // one value per generation computed in this block
+    void _readGenerations(size_t offset, size_t count, DSPSampleType* target)
+    {
+        if (_isHostMode() || isReplaying)
+        {
+            if (target != samples + offset)
+                std::memcpy(target, samples + offset, count * sizeof(DSPSampleType));
+            return;
+        }
+        clEnqueueReadBuffer(commandQueue, samplesMemoryObj, CL_TRUE, offset * sizeof(DSPSampleType), count * sizeof(DSPSampleType), target, 0, NULL, NULL);
+    }
+    
+    void _readCells()
+    {
+        if (isReplaying)
+            return;
+        
+        if (cellsMode == CellsModeContinuousHost)
+        {
+            cellsCPU->copyState(&cells[0].s[0], 4);
+            return;
+        }
+        
+        if (cellsMode != CellsModeContinuous)
+        {
+            _unpackBinaryGrid();
+            return;
+        }
+        clEnqueueReadBuffer(commandQueue, cellsMemoryObj, CL_TRUE, 0, cellsMemoryLength * sizeof(DSPSampleType4), cells, 0, NULL, NULL);
+    }
+    
+public:
+    //! Binary modes round the grid height up to a multiple of 64 cells. The ring buffer and generateSamples carry
+    //! \a initChannelsCount interleaved channels, mixed by the preset made for that count, see setMixingWeights.
+    //! The grid is seeded from \a initSeed, 0 takes one from the clock that getSeed reports.
+    DSPOpenCL(size_t initSampleRate, size_t initBufferSize, CellsMode initCellsMode = CellsModeContinuous, glm::ivec2 initGridSize = glm::ivec2(16, 16), size_t initChannelsCount = 1, uint64_t initSeed = 0) :
+    DSPEngine(initBufferSize, std::max<size_t>(1, initChannelsCount))
+    {
+        this->seed = initSeed != 0 ? initSeed : (cl_ulong)std::chrono::high_resolution_clock::now().time_since_epoch().count();
+        this->pendingSeed = seed;
+        this->isSeedDirty = false;
+        this->channelsCount = std::max<size_t>(1, initChannelsCount);
+        this->mixingPending = NULL;
+        this->isMixingPrepared = false;
+        this->controlRate.setChannels(channelsCount);
+        this->controlRate.setBlockSize(initBufferSize);
+        this->samplesProcessed = 0;
+        this->generationsProcessed = 0;
+        this->controlPendingInterval = 1;
+        this->controlPendingMode = ControlHold;
+        this->isControlRateDirty = false;
+        this->sampleRate = (cl_uint)initSampleRate;
+        this->bufferSize = initBufferSize;
+        this->samplesToWrite = (cl_uint)initBufferSize;
+        this->cellsMode = initCellsMode;
+        this->bitGrid = NULL;
+        this->hashLife = NULL;
+        this->fastForwardPendingLog2 = 0;
+        this->isFastForwardDirty = false;
+        this->cellsCPU = NULL;
+        this->cellsThreadPool = NULL;
+        this->isCellsBlockingDirty = false;
+        this->convolution = NULL;
+        this->isConvolutionEnabled = false;
+        this->isConvolutionPrepared = false;
+        this->boundaryMode = BoundaryTorus;
+        this->boundaryValue = 0.0f;
+        this->isCycleDetectionEnabled = true;
+        this->isQuantizedDirty = false;
+        this->isCycleDetectionDirty = false;
+        this->isBoundaryDirty = false;
+        this->isNeighbourhoodDirty = false;
+        this->isConvolutionDirty = false;
+        this->gridSize = { (cl_uint)initGridSize.x, (cl_uint)initGridSize.y };
+        if (_isBinaryMode())
+            gridSize.s[1] = (gridSize.s[1] + 63) / 64 * 64;
+        
+        prepareCLContext(deviceID, context, commandQueue);
+        isDeviceReady = deviceID != NULL;
+        _prepareKernels("Cells.ncl", { { &cellsKernel, "kernelMain" }, { &seedKernel, "seedMain" }, { &tileSumsKernel, "tileSumsMain" } });
+        _prepareKernels("Processing.ncl", { { &soundKernel, "kernelMain" }, { &mixdownReduceKernel, "reduceMain" }, { &mixdownFinishKernel, "reduceFinishMain" }, { &mixdownTilesKernel, "reduceTilesMain" }, { &mixReduceKernel, "mixReduceMain" }, { &mixFinishKernel, "mixFinishMain" } });
+        if (cellsMode == CellsModeBinary)
+            _prepareKernels("BitCells.ncl", { { &bitStepKernel, "stepMain" }, { &bitMixdownKernel, "mixdownMain" } });
+        _prepareMemory();
+        _prepareGridSnapshots();
+        isPaused = false;
+    }
+    
+    float* getRulesBirthCenter()
+    {
+        return &rules[0];
+    }
+    float* rulesBirthRadius()
+    {
+        return &rules[1];
+    }
+    float* rulesKeepCenter()
+    {
+        return &rules[2];
+    }
+    float* rulesKeepRadius()
+    {
+        return &rules[3];
+    }
+    float* rulesSpeed()
+    {
+        return &rules[4];
+    }
+    
+    //! Snaps cell states to the 2^speed + 1 levels reachable by the rules and evaluates them through a precomputed (state, neighbour sum) table.
+    //! Applied at the next generateSamples call.
+    void setQuantized(bool quantized)
+    {
+        std::lock_guard<std::mutex> lock(settingsMutex);
+        pendingQuantized = quantized;
+        isQuantizedDirty = true;
+    }
+    
+    bool getQuantized()
+    {
+        std::lock_guard<std::mutex> lock(settingsMutex);
+        return isQuantizedDirty ? pendingQuantized : isQuantized;
+    }
+    
+    //! Replaces the rules with an arbitrary transition table of \a levels states, laid out as table[state * (8 * (levels - 1) + 1) + sum]. \return `false` if the table does not fit.
+    bool setTransitionTable(cl_uint levels, const std::vector<cl_float>& table)
+    {
+        if (levels < 2 || table.size() != (size_t)levels * _ruleTableSumLevels(levels) || table.size() > ruleTableMaxLength)
+            return false;
+        
+        std::copy(table.begin(), table.end(), ruleTable);
+        isRuleTableCustom = true;
+        _uploadRuleTable(levels);
+        _invalidateCycle();
+        return true;
+    }
+    
+    void resetTransitionTable()
+    {
+        isRuleTableCustom = false;
+        ruleTableRules[0] = NAN;
+        _uploadRuleTable(0);
+        _invalidateCycle();
+    }
+    
+    ~DSPOpenCL()
+    {
+        delete [] waveTable;
+        delete [] ruleTable;
+        delete [] samples;
+        delete [] cells;
+        delete [] DefferedUpdateGrid;
+        delete bitGrid;
+        delete hashLife;
+        delete cellsCPU;
+        delete cellsThreadPool;
+        delete convolution;
+        delete cycleDetector;
+        delete mixing;
+        delete mixingPending;
+        
+        clReleaseDevice(deviceID);
+        clReleaseContext(context);
+        clReleaseCommandQueue(commandQueue);
+        clReleaseMemObject(cellsMemoryObj);
+        clReleaseMemObject(waveTableMemoryObj);
+        clReleaseMemObject(samplesMemoryObj);
+        clReleaseMemObject(ruleTableMemoryObj);
+        clReleaseMemObject(tileChangedMemoryObj);
+        clReleaseMemObject(tileQuietRunsMemoryObj);
+        clReleaseMemObject(tileSumsMemoryObj);
+        
+        clReleaseKernel(cellsKernel);
+        clReleaseKernel(seedKernel);
+        clReleaseKernel(tileSumsKernel);
+        clReleaseKernel(soundKernel);
+        clReleaseKernel(mixdownReduceKernel);
+        clReleaseKernel(mixdownFinishKernel);
+        clReleaseKernel(mixdownTilesKernel);
+        clReleaseMemObject(mixdownPartialsMemoryObj);
+        clReleaseKernel(mixReduceKernel);
+        clReleaseKernel(mixFinishKernel);
+        
+        if (isMixingPrepared)
+        {
+            clReleaseMemObject(mixWeightsMemoryObj);
+            clReleaseMemObject(mixOffsetsMemoryObj);
+            clReleaseMemObject(mixPartialsMemoryObj);
+            clReleaseMemObject(mixFramesMemoryObj);
+        }
+        
+        if (cellsMode == CellsModeBinary)
+        {
+            clReleaseMemObject(bitCellsMemoryObj[0]);
+            clReleaseMemObject(bitCellsMemoryObj[1]);
+            clReleaseMemObject(bitCountsMemoryObj);
+            clReleaseKernel(bitStepKernel);
+            clReleaseKernel(bitMixdownKernel);
+        }
+        
+        if (isConvolutionPrepared)
+        {
+            clReleaseMemObject(convolutionMemoryObj[0]);
+            clReleaseMemObject(convolutionMemoryObj[1]);
+            clReleaseMemObject(convolutionSpectrumMemoryObj);
+            clReleaseKernel(convolutionLoadKernel);
+            clReleaseKernel(convolutionPassKernel);
+            clReleaseKernel(convolutionMultiplyKernel);
+            clReleaseKernel(convolutionApplyKernel);
+            clReleaseKernel(windowRowsKernel);
+            clReleaseKernel(windowColumnsKernel);
+        }
+    }
+    
+    CellsMode getCellsMode()
+    {
+        return cellsMode;
+    }
+    
+    //! Replays the output once the grid repeats itself, until an edit or rule change. Not available in CellsModeBinary.
+    //! Applied at the next generateSamples call.
+    void setCycleDetection(bool enabled)
+    {
+        std::lock_guard<std::mutex> lock(settingsMutex);
+        pendingCycleDetection = enabled;
+        isCycleDetectionDirty = true;
+    }
+    
+    bool getCycleDetection()
+    {
+        std::lock_guard<std::mutex> lock(settingsMutex);
+        return isCycleDetectionDirty ? pendingCycleDetection : isCycleDetectionEnabled;
+    }
+    
+    //! \return the replayed period in samples, 0 while computing.
+    size_t getCyclePeriod()
+    {
+        return cycleDetector != NULL && cycleDetector->isLocked() ? cycleDetector->getPeriod() : 0;
+    }
+    
+    //! Overrides the neighbourhood with a radial kernel summed by FFT convolution, normalized so a fully alive
+    //! neighbourhood sums to 8 like the Moore one and the rules keep their meaning. The kernel spectrum is only rebuilt when the kernel changes.
+    //! Applied at the next generateSamples call. \return `false` unless the mode is continuous and both grid sides are powers of two.
+    bool setConvolutionKernel(const ConvolutionKernel& kernel)
+    {
+        if (_isBinaryMode() || !ConvolutionCPU::supportsSize(gridSize.s[0], gridSize.s[1]))
+            return false;
+        
+        std::lock_guard<std::mutex> lock(settingsMutex);
+        pendingConvolutionKernel = kernel;
+        pendingConvolutionEnabled = true;
+        isConvolutionDirty = true;
+        return true;
+    }
+    
+    //! Square or cross neighbourhood of any radius for the continuous rules, summed by separable running sums at a cost independent of the radius.
+    //! Sums are rescaled to the 8 neighbours the rules are written for, the radius 1 square runs on the Cells.ncl stencil. Replaces a convolution kernel.
+    //! Applied at the next generateSamples call. \return `false` in binary modes.
+    bool setNeighbourhood(const Neighbourhood& newNeighbourhood)
+    {
+        if (_isBinaryMode())
+            return false;
+        
+        std::lock_guard<std::mutex> lock(settingsMutex);
+        pendingNeighbourhood = newNeighbourhood;
+        isNeighbourhoodDirty = true;
+        pendingConvolutionEnabled = false;
+        isConvolutionDirty = true;
+        return true;
+    }
+    
+    Neighbourhood getNeighbourhood()
+    {
+        std::lock_guard<std::mutex> lock(settingsMutex);
+        return isNeighbourhoodDirty ? pendingNeighbourhood : neighbourhood;
+    }
+    
+    //! CellsModeContinuousHost: advances up to \a generations generations per sweep over cache sized tiles shared by \a threads
+    //! threads, 0 for every core. Blocking needs the radius 1 neighbourhood on a torus, and is skipped while
+    //! cycle detection or control rate oscillators need every generation. \return `false` in other modes.
+    bool setTemporalBlocking(size_t generations, size_t threads = 0)
+    {
+        if (cellsMode != CellsModeContinuousHost)
+            return false;
+        
+        cellsBlockGenerations = generations;
+        cellsBlockThreads = threads;
+        isCellsBlockingDirty = true;
+        return true;
+    }
+    
+    //! Steps the automaton once every \a samplesPerGeneration samples and fills the samples in between by \a interpolation,
+    //! so the compute cost follows the generation rate instead of the sample rate. Applied at the next generateSamples call.
+    //! \return `false` for ControlOscillators in binary modes, which have no per-cell states to drive them.
+    bool setControlRate(size_t samplesPerGeneration, ControlInterpolation interpolation = ControlLinear)
+    {
+        if (interpolation == ControlOscillators && _isBinaryMode())
+            return false;
+        
+        controlPendingInterval = std::max<size_t>(1, samplesPerGeneration);
+        controlPendingMode = interpolation;
+        isControlRateDirty = true;
+        return true;
+    }
+    
+    size_t getSamplesPerGeneration()
+    {
+        return isControlRateDirty ? controlPendingInterval : controlRate.getInterval();
+    }
+    
+    //! What the radius 1 stencil sees past the grid edges, \a value is the cell state BoundaryFixed reads.
+    //! Wide neighbourhoods always wrap. Applied at the next generateSamples call. \return `false` in binary modes, which are toroidal.
+    bool setBoundary(BoundaryMode mode, cl_float value = 0.0f)
+    {
+        if (_isBinaryMode())
+            return false;
+        
+        std::lock_guard<std::mutex> lock(settingsMutex);
+        pendingBoundaryMode = mode;
+        pendingBoundaryValue = value;
+        isBoundaryDirty = true;
+        return true;
+    }
+    
+    BoundaryMode getBoundaryMode()
+    {
+        std::lock_guard<std::mutex> lock(settingsMutex);
+        return (BoundaryMode)(isBoundaryDirty ? pendingBoundaryMode : boundaryMode);
+    }
+    
+    //! Replaces every cell state with uniform values keyed by \a newSeed and the cell index, the same on host and device,
+    //! so a render is reproducible from its seed. Applied at the next generateSamples call.
+    void reseed(uint64_t newSeed)
+    {
+        pendingSeed = newSeed;
+        isSeedDirty = true;
+    }
+    
+    uint64_t getSeed()
+    {
+        return isSeedDirty ? pendingSeed : seed;
+    }
+    
+    //! Writes the grid, rules, seed and generation count to \a path as they stand at the start of the next block that
+    //! finds the engine's staging copy free, which is the next one unless the last save is still being written.
+    //! The file is written from a background thread, so a save never holds up the block that takes it.
+    void saveSnapshot(const std::string& path)
+    {
+        std::lock_guard<std::mutex> lock(snapshotMutex);
+        snapshotSavePaths.push_back(path);
+    }
+    
+    //! Maps \a path and restores it at the start of the next block, replacing any pending reseed.
+    //! \return `false` if it is not a snapshot of a grid of this size and precision saved in this engine's cells mode,
+    //! the mode is fixed at construction and the grid of one mode does not mean the same in another.
+    bool loadSnapshot(const std::string& path)
+    {
+        std::shared_ptr<SnapshotFile> file = std::make_shared<SnapshotFile>();
+        if (!file->open(path))
+            return false;
+        
+        const SnapshotHeader& header = file->getHeader();
+        if (header.width != gridSize.s[0] || header.height != gridSize.s[1] || header.componentBytes != sizeof(DSPSampleType) || header.componentsCount != 4
+            || header.cellsMode != (uint32_t)cellsMode)
+            return false;
+        
+        std::lock_guard<std::mutex> lock(snapshotMutex);
+        snapshotPending = file;
+        return true;
+    }
+    
+    size_t getChannelsCount()
+    {
+        return channelsCount;
+    }
+    
+    //! Mixes the cells into the output channels by \a preset, applied at the next generateSamples call.
+    //! \return `false` in binary modes or if the preset does not make getChannelsCount() channels.
+    bool setMixingPreset(MixingPreset preset)
+    {
+        MixingMatrix* matrix = new MixingMatrix(gridSize.s[0], gridSize.s[1]);
+        if (_isBinaryMode() || !matrix->setPreset(preset) || matrix->getChannelsCount() != channelsCount)
+        {
+            delete matrix;
+            return false;
+        }
+        _setPendingMixing(matrix);
+        return true;
+    }
+    
+    //! Arbitrary weights, getCellsCount() per channel and channel after channel, each applied to 2 * state - 1 of its cell.
+    //! \return `false` in binary modes or if the size does not match.
+    bool setMixingWeights(const std::vector<float>& weights)
+    {
+        MixingMatrix* matrix = new MixingMatrix(gridSize.s[0], gridSize.s[1]);
+        if (_isBinaryMode() || !matrix->setWeights(channelsCount, weights))
+        {
+            delete matrix;
+            return false;
+        }
+        _setPendingMixing(matrix);
+        return true;
+    }
+    
+    MixingPreset getMixingPreset()
+    {
+        std::lock_guard<std::mutex> lock(mixingMutex);
+        return mixingPending != NULL ? mixingPending->getPreset() : mixing->getPreset();
+    }
+    
+    //! Back to the configured neighbourhood at the next generateSamples call.
+    void resetConvolutionKernel()
+    {
+        std::lock_guard<std::mutex> lock(settingsMutex);
+        pendingConvolutionEnabled = false;
+        isConvolutionDirty = true;
+    }
+    
+    bool getConvolution()
+    {
+        std::lock_guard<std::mutex> lock(settingsMutex);
+        return isConvolutionDirty ? pendingConvolutionEnabled : isConvolutionEnabled;
+    }
+    
+    //! Jumps the grid 2^generationsLog2 generations ahead with the binary reading of the rules at the start of the next block,
+    //! cells are thresholded at 0.5. \return `false` unless the grid is a square power of two of at least 8 cells on a torus
+    //! with the Moore neighbourhood. Settings changed before that block are checked again then.
+    bool fastForward(cl_uint generationsLog2)
+    {
+        if (!_canFastForward())
+            return false;
+        
+        fastForwardPendingLog2 = generationsLog2;
+        isFastForwardDirty = true;
+        return true;
+    }
+    
+    DSPBackend getBackend()
+    {
+        return DSPBackendOpenCL;
+    }
+    
+    //! Whether any OpenCL device is there to build the engine on, see createDSPEngine.
+    static bool isAvailable()
+    {
+        return hasCLDevice();
+    }
+    
+    //! `false` if there was no device or a program did not build for it, the engine then renders nothing useful.
+    bool isReady()
+    {
+        return isDeviceReady;
+    }
+    
+    cl_device_id getDeviceID()
+    {
+        return deviceID;
+    }
+    
+    bool pause()
+    {
+        isPaused = !isPaused;
+        return isPaused;
+    }
+    
+    DSPSampleType4* getCurrentGridState()
+    {
+        return &cells[0];
+    }
+    
+    glm::ivec2 getGridSize()
+    {
+        return glm::ivec2(gridSize.s[0], gridSize.s[1]);
+    }
+    
+    size_t getCellsCount()
+    {
+        return cellsCount;
+    }
+    
+    void generateSamples(float* data = NULL)
+    {
+        if (isPaused)
+            return;
+        
+        size_t toWrite = _getFramesToWrite();
+        
+        if (toWrite <= 0)
+            return;
+        
+        _applyControlRate();
+        _applyMixing();
+        _applySettings();
+        _applySnapshots();
+        size_t generations = controlRate.isPassthrough() ? toWrite : controlRate.generationsFor(toWrite);
+        
+        clEnqueueWriteBuffer(commandQueue, rulesMemoryObject, CL_TRUE, 0, rulesMemoryLength * sizeof(cl_float), rules, 0, NULL, NULL);
+        _updateRuleTable();
+        _updateBinaryRule();
+        _checkCycleInvalidation();
+        _applySeed();
+        _applyDefferedUpdateGrid();
+        _applyFastForward();
+        
+        _updateSamplesProcessed();
+        _updateSamplesToWrite(generations);
+
+        isReplaying = cycleDetector != NULL && isCycleDetectionEnabled && cycleDetector->isLocked();
+        bool trackContinuous = generations > 0 && !isReplaying && cellsMode == CellsModeContinuous && cycleDetector != NULL && isCycleDetectionEnabled;
+        if (trackContinuous)
+            _extractCycleState(0, cycleFirstState);
+        
+        if (generations == 0)
         {
-            clEnqueueReadBuffer(commandQueue, samplesMemoryObj, CL_TRUE, 0, firstLength * sizeof(DSPSampleType), firstPart, 0, NULL, NULL);
-            samplesProcessed += firstLength;
-            if (secondPart != nullptr)
+            // the block is covered by generations computed ahead
+        }
+        else if (isReplaying)
+        {
+            _processReplay(generations);
+        }
+        else
+        {
+            switch (cellsMode)
             {
-                clEnqueueReadBuffer(commandQueue, samplesMemoryObj, CL_TRUE, firstLength * sizeof(DSPSampleType), secondLength * sizeof(DSPSampleType), secondPart, 0, NULL, NULL);
-                samplesProcessed += secondLength;
+                case CellsModeBinary:
+                    _processBinary(generations);
+                    break;
+                case CellsModeBinaryHost:
+                    _processBinaryHost(generations);
+                    break;
+                case CellsModeContinuousHost:
+                    _processContinuousHost(generations);
+                    break;
+                default:
+                    _processContinuous(generations);
+                    break;
             }
+        }
+        
+        if (generations > 0)
+        {
+            _readCells();
+            _readFrames(generations);
+        }
+        if (!controlRate.isPassthrough())
+            _renderControlRate(generations, toWrite);
+        generationsProcessed += generations;
+        
+#if LOGENABLED
+        bool logHard = false;
+        if (logHard && generations > 0)
+        {
+            _readGenerations(0, generations, samples);
+            
+            int tail = generations;
+            int radius = 10;
             
+            for(int i = 0; i < radius; ++i)
+            {
+                std::cerr << i << " " << samples[i] << std::endl;
+            }
+            for(int i = tail - radius; i < tail; ++i)
+            {
+                std::cerr << i << " " << samples[i] << std::endl;
+            }
         }
-#else
-        clEnqueueReadBuffer(commandQueue, samplesMemoryObj, CL_TRUE, 0, toWrite * sizeof(DSPSampleType), samples, 0, NULL, NULL);
-
-        RingBuffer.write(samples, toWrite);
-        samplesProcessed += toWrite;
 #endif
+        
+        if (data != NULL)
+        {
+            _readSamples(0, toWrite, data);
+            _shareBlock(data, toWrite);
+            samplesProcessed += toWrite;
+        }
+        else
+        {
+            samplesProcessed += _writeRing(toWrite, channelsCount, samples, [this](size_t offset, size_t count, DSPSampleType* target) { _readSamples(offset, count, target); });
         }
 #if LOGENABLED
         std::cerr << "[ProcessingThread]: processed " << toWrite << "samples" << std::endl;
 #endif
+        _publishGridSnapshot(toWrite);
         
-        clEnqueueReadBuffer(commandQueue, cellsMemoryObj, CL_TRUE, 0, cellsMemoryLength * sizeof(DSPSampleType4), cells, 0, NULL, NULL);
+        if (trackContinuous)
+            _trackContinuousCycle(generations);
     }
 };
 
@@ -10,27 +10,14 @@
 #define DSPOpenGL_h
 
 #include "Utils.h"
+#include "DSPEngine.h"
 #include "cinder/gl/gl.h"
 #include "cinder/app/cocoa/PlatformCocoa.h"
-#include "cinder/audio/audio.h"
-#include "cinder/audio/dsp/Dsp.h"
 
-typedef GLfloat                     DSPSampleType;
-
-#if UNSAFEBUFFER
-#include "UnsafeRingBuffer.h"
-typedef UnsafeRingBufferT<DSPSampleType> RingBuffer;
-#else
-#include "cinder/audio/audio.h"
-#include "cinder/audio/dsp/Dsp.h"
-typedef ci::audio::dsp::RingBufferT<DSPSampleType> RingBuffer;
-#endif
-
-class DSPOpenGL
+//! Transform feedback oscillator bank from GPUDSP.vert. It runs no automaton, so its grid is a single idle cell
+//! that keeps the DSPEngine surface usable. Every call, generateSamples included, needs its GL context current.
+class DSPOpenGL : public DSPEngine
 {
-public:
-    RingBuffer RingBuffer;
-    
 private:
     GLuint _nodesVBO;
     GLuint _nodesVAO;
@@ -48,6 +35,11 @@ private:
     
     size_t _samplesProcessed;
     size_t _sampleRate;
+    bool _isPaused;
+    
+    DSPSampleType4 _cell;
+    float _rules[5];
+    uint64_t _seed;
     
     typedef std::basic_string<GLchar>   GLstring;
     
@@ -161,16 +153,24 @@ private:
     
 public:
     DSPOpenGL(size_t sampleRate, size_t bufferSize) :
-    RingBuffer(bufferSize)
+    DSPEngine(bufferSize, 1)
     {
         _samplesProcessed = 0;
         _sampleRate = sampleRate;
+        _isPaused = false;
+        _cell = DSPSampleType4();
+        std::fill(_rules, _rules + 5, 0.0f);
+        _seed = 0;
+        DefferedUpdateGrid = new DSPSampleType4[1]();
         _generateNodes();
+        // the idle cell never changes, so this snapshot is the only one
+        _prepareGridSnapshots();
     }
     
     ~DSPOpenGL()
     {
         delete [] _feedbackData;
+        delete [] DefferedUpdateGrid;
         
         glDeleteProgram(_DSPProgram);
         glDeleteShader(_DSPShader);
@@ -183,17 +183,93 @@ public:
         glDeleteVertexArrays(1, &_nodesVAO);
     }
     
+    //! Transform feedback needs GL 3.3 for GPUDSP.vert, the version of the current context decides.
+    static bool isAvailable()
+    {
+        GLint major = 0;
+        GLint minor = 0;
+        glGetIntegerv(GL_MAJOR_VERSION, &major);
+        glGetIntegerv(GL_MINOR_VERSION, &minor);
+        return major > 3 || (major == 3 && minor >= 3);
+    }
+    
+    DSPBackend getBackend()
+    {
+        return DSPBackendOpenGL;
+    }
+    
     size_t getBufferSize()
     {
         return RingBuffer.getSize();
     }
     
-    void generateSamples()
+    bool pause()
+    {
+        _isPaused = !_isPaused;
+        return _isPaused;
+    }
+    
+    size_t getChannelsCount()
+    {
+        return 1;
+    }
+    
+    glm::ivec2 getGridSize()
+    {
+        return glm::ivec2(1, 1);
+    }
+    
+    size_t getCellsCount()
+    {
+        return 1;
+    }
+    
+    DSPSampleType4* getCurrentGridState()
+    {
+        return &_cell;
+    }
+    
+    float* getRulesBirthCenter()
+    {
+        return &_rules[0];
+    }
+    float* rulesBirthRadius()
+    {
+        return &_rules[1];
+    }
+    float* rulesKeepCenter()
+    {
+        return &_rules[2];
+    }
+    float* rulesKeepRadius()
+    {
+        return &_rules[3];
+    }
+    float* rulesSpeed()
+    {
+        return &_rules[4];
+    }
+    
+    void reseed(uint64_t newSeed)
     {
-        size_t toWrite = RingBuffer.getAvailableWrite();
+        _seed = newSeed;
+    }
+    
+    uint64_t getSeed()
+    {
+        return _seed;
+    }
+    
+    void generateSamples(float* data = NULL)
+    {
+        if (_isPaused)
+            return;
+        
+        size_t toWrite = _getFramesToWrite();
         
         if (toWrite <= 0)
             return;
+        DefferedUpdateGrid[0] = DSPSampleType4();
         
         glEnable(GL_RASTERIZER_DISCARD);
         glUseProgram(_DSPProgram);
@@ -216,29 +292,19 @@ public:
         glUseProgram(0);
         
         // recieve processed data from feedback
-#if UNSAFEBUFFER
-        DSPSampleType* firstPart = nullptr;
-        DSPSampleType* secondPart = nullptr;
-        size_t firstLength = 0;
-        size_t secondLength = 0;
-        
-        RingBuffer.getUnsafeDataWritePointer(toWrite, firstPart, secondPart, firstLength, secondLength);
-        if (firstPart != nullptr)
+        auto readFeedback = [](size_t offset, size_t count, DSPSampleType* target)
+        {
+            glGetBufferSubData(GL_TRANSFORM_FEEDBACK_BUFFER, offset * sizeof(DSPSampleType), count * sizeof(DSPSampleType), target);
+        };
+        if (data != NULL)
         {
-            glGetBufferSubData(GL_TRANSFORM_FEEDBACK_BUFFER, 0, firstLength * sizeof(DSPSampleType), firstPart);
-            _samplesProcessed += firstLength;
-            if (secondPart != nullptr)
-            {
-                glGetBufferSubData(GL_TRANSFORM_FEEDBACK_BUFFER, firstLength * sizeof(DSPSampleType), secondLength * sizeof(DSPSampleType), secondPart);
-                _samplesProcessed += secondLength;
-            }
-            
+            readFeedback(0, toWrite, data);
+            _samplesProcessed += toWrite;
+        }
+        else
+        {
+            _samplesProcessed += _writeRing(toWrite, 1, _feedbackData, readFeedback);
         }
-#else
-        glGetBufferSubData(GL_TRANSFORM_FEEDBACK_BUFFER, 0, toWrite * sizeof(DSPSampleType), _feedbackData);
-        RingBuffer.write(_feedbackData, toWrite);
-        _samplesProcessed += toWrite;
-#endif
         
 #if LOGENABLED
         std::cerr << "[ProcessingThread]: processed " << toWrite << "samples" << std::endl;
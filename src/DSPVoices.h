@@ -0,0 +1,465 @@
+//
+//  DSPVoices.h
+//  GPUDSP
+//
+//  Many independent continuous automata advanced and mixed by one pair of launches per block.
+//
+
+#ifndef DSPVoices_h
+#define DSPVoices_h
+
+#include "DSPOpenCL.h"
+#include <chrono>
+#include <mutex>
+
+// rules of one voice, laid out like DSPOpenCL rules: birth center, birth radius, keep center, keep radius, speed
+const size_t            voiceRulesLength = 5;
+
+//! Voices share the context, queue, programs and grid size, and live in fixed slots of one slab of device memory.
+//! Each voice is a toroidal radius 1 grid with its own rules, seed and gain, stepped by one work group out of local memory,
+//! so a voice grid must fit a work group of the device: no more cells than the kernel work group size (often 256, a 16x16
+//! grid) and three grids in local memory. isReady() is `false` otherwise and no voice is allocated.
+//! Voice 0 is the one the app shows and edits through the DSPEngine controls, it is allocated by the constructor and never freed.
+//! The mono mix sounds the same on every channel.
+class DSPVoices : public DSPEngine
+{
+private:
+    void logErrorString(cl_int error)
+    {
+        logCLError(error);
+    }
+
+protected:
+    cl_device_id        deviceID;
+    cl_context          context;
+    cl_command_queue    commandQueue;
+
+    cl_kernel           stepKernel;
+    cl_kernel           mixKernel;
+
+    cl_uint2            gridSize;
+    size_t              cellsCount;
+    size_t              voicesCapacity;
+    bool                isGridSupported;
+
+    cl_mem              voiceCellsMemoryObj;
+    cl_mem              voiceRulesMemoryObj;
+    cl_mem              voiceGainsMemoryObj;
+    cl_mem              voiceSamplesMemoryObj;
+    cl_mem              activeVoicesMemoryObj;
+    cl_mem              samplesMemoryObj;
+
+    // slab bookkeeping, written by the allocating thread and uploaded at the start of a block
+    std::mutex          voicesMutex;
+    std::vector<cl_float> voiceRules;
+    std::vector<cl_float> voiceGains;
+    std::vector<bool>   isVoiceActive;
+    std::vector<cl_uint> freeVoices;
+    std::vector<cl_uint> activeVoices;
+    std::vector<std::pair<cl_uint, std::vector<cl_float>>> pendingSeeds;
+    bool                isVoicesDirty;
+
+    // voice 0 on the host, read back after every block
+    DSPSampleType4*     cells;
+    std::vector<cl_float> voiceCells;
+    float               rules[voiceRulesLength];
+    uint64_t            seed;
+    uint64_t            pendingSeed;
+    bool                isSeedDirty;
+
+    std::vector<DSPSampleType> mono;
+    std::vector<DSPSampleType> samples;
+    size_t              channelsCount;
+    cl_uint             sampleRate;
+    size_t              bufferSize;
+    size_t              samplesProcessed;
+    bool                isPaused;
+
+    void _prepareMemory()
+    {
+        cl_int ret = 0;
+        voiceCellsMemoryObj = clCreateBuffer(context, CL_MEM_READ_WRITE, voicesCapacity * cellsCount * sizeof(cl_float), NULL, &ret);
+        logErrorString(ret);
+        voiceRulesMemoryObj = clCreateBuffer(context, CL_MEM_READ_ONLY, voicesCapacity * voiceRulesLength * sizeof(cl_float), NULL, &ret);
+        logErrorString(ret);
+        voiceGainsMemoryObj = clCreateBuffer(context, CL_MEM_READ_ONLY, voicesCapacity * sizeof(cl_float), NULL, &ret);
+        logErrorString(ret);
+        voiceSamplesMemoryObj = clCreateBuffer(context, CL_MEM_READ_WRITE, bufferSize * voicesCapacity * sizeof(DSPSampleType), NULL, &ret);
+        logErrorString(ret);
+        activeVoicesMemoryObj = clCreateBuffer(context, CL_MEM_READ_ONLY, voicesCapacity * sizeof(cl_uint), NULL, &ret);
+        logErrorString(ret);
+        samplesMemoryObj = clCreateBuffer(context, CL_MEM_READ_WRITE, bufferSize * sizeof(DSPSampleType), NULL, &ret);
+        logErrorString(ret);
+
+        cl_uint capacityArg = (cl_uint)voicesCapacity;
+        ret = clSetKernelArg(stepKernel, 0, sizeof(cl_mem), (void*)&voiceSamplesMemoryObj);
+        logErrorString(ret);
+        ret = clSetKernelArg(stepKernel, 1, sizeof(cl_mem), (void*)&voiceCellsMemoryObj);
+        logErrorString(ret);
+        ret = clSetKernelArg(stepKernel, 2, sizeof(cl_mem), (void*)&voiceRulesMemoryObj);
+        logErrorString(ret);
+        ret = clSetKernelArg(stepKernel, 3, sizeof(cl_mem), (void*)&activeVoicesMemoryObj);
+        logErrorString(ret);
+        ret = clSetKernelArg(stepKernel, 4, sizeof(cl_uint2), (void*)&gridSize);
+        logErrorString(ret);
+        ret = clSetKernelArg(stepKernel, 5, sizeof(cl_uint), (void*)&capacityArg);
+        logErrorString(ret);
+        for (cl_uint arg = 7; arg < 10; ++arg)
+        {
+            ret = clSetKernelArg(stepKernel, arg, cellsCount * sizeof(DSPSampleType), NULL);
+            logErrorString(ret);
+        }
+
+        ret = clSetKernelArg(mixKernel, 0, sizeof(cl_mem), (void*)&samplesMemoryObj);
+        logErrorString(ret);
+        ret = clSetKernelArg(mixKernel, 1, sizeof(cl_mem), (void*)&voiceSamplesMemoryObj);
+        logErrorString(ret);
+        ret = clSetKernelArg(mixKernel, 2, sizeof(cl_mem), (void*)&voiceGainsMemoryObj);
+        logErrorString(ret);
+        ret = clSetKernelArg(mixKernel, 3, sizeof(cl_mem), (void*)&activeVoicesMemoryObj);
+        logErrorString(ret);
+        ret = clSetKernelArg(mixKernel, 5, sizeof(cl_uint), (void*)&capacityArg);
+        logErrorString(ret);
+    }
+
+    // a voice is one work group, which caps the cells of a grid
+    bool _checkGridSupported()
+    {
+        size_t groupSize = 0;
+        cl_ulong localMemorySize = 0;
+        cl_int ret = clGetKernelWorkGroupInfo(stepKernel, deviceID, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &groupSize, NULL);
+        logErrorString(ret);
+        ret = clGetDeviceInfo(deviceID, CL_DEVICE_LOCAL_MEM_SIZE, sizeof(cl_ulong), &localMemorySize, NULL);
+        logErrorString(ret);
+        return cellsCount <= groupSize && 3 * cellsCount * sizeof(DSPSampleType) <= localMemorySize;
+    }
+
+    // reseed and grid edits of voice 0, applied to the host copy and uploaded whole
+    void _applyVoiceEdits()
+    {
+        bool edited = false;
+        if (isSeedDirty)
+        {
+            seed = pendingSeed;
+            isSeedDirty = false;
+            for (size_t i = 0; i < cellsCount; ++i)
+                cells[i].s[0] = philoxCellUniform(seed, (uint32_t)i);
+            edited = true;
+        }
+        for (size_t i = 0; i < cellsCount; ++i)
+        {
+            if (DefferedUpdateGrid[i].s[0] == 0.0f)
+                continue;
+            cells[i] = DefferedUpdateGrid[i].s[0] > 0.0f ? DefferedUpdateGrid[i] : DSPSampleType4();
+            DefferedUpdateGrid[i] = DSPSampleType4();
+            edited = true;
+        }
+        if (!edited)
+            return;
+        
+        for (size_t i = 0; i < cellsCount; ++i)
+            voiceCells[i] = cells[i].s[0];
+        clEnqueueWriteBuffer(commandQueue, voiceCellsMemoryObj, CL_TRUE, 0, cellsCount * sizeof(cl_float), voiceCells.data(), 0, NULL, NULL);
+    }
+
+    void _readVoiceCells()
+    {
+        clEnqueueReadBuffer(commandQueue, voiceCellsMemoryObj, CL_TRUE, 0, cellsCount * sizeof(cl_float), voiceCells.data(), 0, NULL, NULL);
+        for (size_t i = 0; i < cellsCount; ++i)
+            cells[i].s[0] = voiceCells[i];
+    }
+
+    // slab changes reach the device between blocks, on the processing thread
+    void _uploadVoices()
+    {
+        std::lock_guard<std::mutex> lock(voicesMutex);
+        for (auto& seed : pendingSeeds)
+            clEnqueueWriteBuffer(commandQueue, voiceCellsMemoryObj, CL_TRUE, seed.first * cellsCount * sizeof(cl_float), cellsCount * sizeof(cl_float), seed.second.data(), 0, NULL, NULL);
+        pendingSeeds.clear();
+
+        if (!isVoicesDirty)
+            return;
+
+        activeVoices.clear();
+        for (cl_uint voice = 0; voice < voicesCapacity; ++voice)
+            if (isVoiceActive[voice])
+                activeVoices.push_back(voice);
+
+        // voice 0 takes rules every block
+        if (voicesCapacity > 1)
+            clEnqueueWriteBuffer(commandQueue, voiceRulesMemoryObj, CL_TRUE, voiceRulesLength * sizeof(cl_float), (voiceRules.size() - voiceRulesLength) * sizeof(cl_float), &voiceRules[voiceRulesLength], 0, NULL, NULL);
+        clEnqueueWriteBuffer(commandQueue, voiceGainsMemoryObj, CL_TRUE, 0, voiceGains.size() * sizeof(cl_float), voiceGains.data(), 0, NULL, NULL);
+        if (!activeVoices.empty())
+            clEnqueueWriteBuffer(commandQueue, activeVoicesMemoryObj, CL_TRUE, 0, activeVoices.size() * sizeof(cl_uint), activeVoices.data(), 0, NULL, NULL);
+        isVoicesDirty = false;
+    }
+
+    // every active voice advances through the block in one launch, a second one mixes them
+    void _process(size_t toWrite)
+    {
+        cl_uint samplesToWrite = (cl_uint)toWrite;
+        cl_uint activeCount = (cl_uint)activeVoices.size();
+        clSetKernelArg(stepKernel, 6, sizeof(cl_uint), (void*)&samplesToWrite);
+        clSetKernelArg(mixKernel, 4, sizeof(cl_uint), (void*)&activeCount);
+
+        if (activeCount > 0)
+        {
+            size_t localWorkSize[2] = { cellsCount, 1 };
+            size_t globalWorkSize[2] = { cellsCount, activeCount };
+            clEnqueueNDRangeKernel(commandQueue, stepKernel, 2, NULL, globalWorkSize, localWorkSize, 0, NULL, NULL);
+        }
+
+        size_t mixWorkSize[1] = { toWrite };
+        clEnqueueNDRangeKernel(commandQueue, mixKernel, 1, NULL, mixWorkSize, NULL, 0, NULL, NULL);
+    }
+
+    // the mono mix fanned out to interleaved frames
+    void _readSamples(size_t offset, size_t count, DSPSampleType* target)
+    {
+        for (size_t frame = 0; frame < count; ++frame)
+            for (size_t channel = 0; channel < channelsCount; ++channel)
+                target[frame * channelsCount + channel] = mono[offset + frame];
+    }
+
+public:
+    DSPVoices(size_t initSampleRate, size_t initBufferSize, size_t initVoicesCapacity = 32, glm::ivec2 initGridSize = glm::ivec2(16, 16), size_t initChannelsCount = 1, uint64_t initSeed = 0) :
+    DSPEngine(initBufferSize, std::max<size_t>(1, initChannelsCount))
+    {
+        this->sampleRate = (cl_uint)initSampleRate;
+        this->bufferSize = initBufferSize;
+        this->channelsCount = std::max<size_t>(1, initChannelsCount);
+        this->samplesProcessed = 0;
+        this->isPaused = false;
+        this->voicesCapacity = std::max<size_t>(1, initVoicesCapacity);
+        this->gridSize = { (cl_uint)initGridSize.x, (cl_uint)initGridSize.y };
+        this->cellsCount = gridSize.s[0] * gridSize.s[1];
+        this->voiceRules.assign(voicesCapacity * voiceRulesLength, 0.0f);
+        this->voiceGains.assign(voicesCapacity, 0.0f);
+        this->isVoiceActive.assign(voicesCapacity, false);
+        this->isVoicesDirty = true;
+        this->mono.resize(bufferSize);
+        this->samples.resize(bufferSize * channelsCount);
+        this->voiceCells.resize(cellsCount);
+
+        // the DSPOpenCL defaults, so switching backends keeps the sound
+        rules[0] = 1.89f;
+        rules[1] = 0.35f;
+        rules[2] = 1.89f;
+        rules[3] = 0.36f;
+        rules[4] = 0.0625f;
+
+        cells = new DSPSampleType4[cellsCount]();
+        DefferedUpdateGrid = new DSPSampleType4[cellsCount]();
+        seed = initSeed != 0 ? initSeed : (uint64_t)std::chrono::high_resolution_clock::now().time_since_epoch().count();
+        pendingSeed = seed;
+        isSeedDirty = false;
+        for (size_t i = 0; i < cellsCount; ++i)
+            cells[i].s[0] = philoxCellUniform(seed, (uint32_t)i);
+
+        // lowest slots are handed out first
+        for (size_t voice = voicesCapacity; voice-- > 0;)
+            freeVoices.push_back((cl_uint)voice);
+
+        prepareCLContext(deviceID, context, commandQueue);
+        prepareCLKernels(deviceID, context, "Voices.ncl", { { &stepKernel, "stepMain" }, { &mixKernel, "mixMain" } });
+        isGridSupported = _checkGridSupported();
+#if LOGENABLED
+        if (!isGridSupported)
+            std::cerr << "[Voices]: a " << gridSize.s[0] << "x" << gridSize.s[1] << " grid does not fit a work group" << std::endl;
+#endif
+        _prepareMemory();
+
+        allocateVoice(rules, seed);
+        _prepareGridSnapshots();
+    }
+
+    ~DSPVoices()
+    {
+        delete [] cells;
+        delete [] DefferedUpdateGrid;
+        clReleaseMemObject(voiceCellsMemoryObj);
+        clReleaseMemObject(voiceRulesMemoryObj);
+        clReleaseMemObject(voiceGainsMemoryObj);
+        clReleaseMemObject(voiceSamplesMemoryObj);
+        clReleaseMemObject(activeVoicesMemoryObj);
+        clReleaseMemObject(samplesMemoryObj);
+        clReleaseKernel(stepKernel);
+        clReleaseKernel(mixKernel);
+        clReleaseCommandQueue(commandQueue);
+        clReleaseContext(context);
+        clReleaseDevice(deviceID);
+    }
+
+    //! Takes a free slot for a voice with \a rules (voiceRulesLength values) whose cells are seeded like DSPOpenCL::reseed(\a seed).
+    //! The voice sounds from the next block on. \return the voice, or -1 when the slab is full or the grid does not fit the device.
+    int allocateVoice(const cl_float* newRules, uint64_t voiceSeed, cl_float gain = 1.0f)
+    {
+        if (!isGridSupported)
+            return -1;
+
+        std::vector<cl_float> seeded(cellsCount);
+        for (size_t i = 0; i < cellsCount; ++i)
+            seeded[i] = philoxCellUniform(voiceSeed, (uint32_t)i);
+
+        std::lock_guard<std::mutex> lock(voicesMutex);
+        if (freeVoices.empty())
+            return -1;
+
+        cl_uint voice = freeVoices.back();
+        freeVoices.pop_back();
+        std::copy(newRules, newRules + voiceRulesLength, &voiceRules[voice * voiceRulesLength]);
+        voiceGains[voice] = gain;
+        isVoiceActive[voice] = true;
+        pendingSeeds.emplace_back(voice, std::move(seeded));
+        isVoicesDirty = true;
+        return (int)voice;
+    }
+
+    //! Silences \a voice from the next block on and returns its slot to the slab. Voice 0 stays.
+    void freeVoice(int voice)
+    {
+        std::lock_guard<std::mutex> lock(voicesMutex);
+        if (voice <= 0 || voice >= (int)voicesCapacity || !isVoiceActive[voice])
+            return;
+
+        isVoiceActive[voice] = false;
+        freeVoices.push_back((cl_uint)voice);
+        isVoicesDirty = true;
+    }
+
+    //! Rules of voice 0 are the ones the DSPEngine rule controls point at.
+    void setVoiceRules(int voice, const cl_float* newRules)
+    {
+        std::lock_guard<std::mutex> lock(voicesMutex);
+        if (voice < 0 || voice >= (int)voicesCapacity)
+            return;
+
+        std::copy(newRules, newRules + voiceRulesLength, voice == 0 ? rules : &voiceRules[voice * voiceRulesLength]);
+        isVoicesDirty = true;
+    }
+
+    void setVoiceGain(int voice, cl_float gain)
+    {
+        std::lock_guard<std::mutex> lock(voicesMutex);
+        if (voice < 0 || voice >= (int)voicesCapacity)
+            return;
+
+        voiceGains[voice] = gain;
+        isVoicesDirty = true;
+    }
+
+    size_t getVoicesCapacity()
+    {
+        return voicesCapacity;
+    }
+
+    size_t getActiveVoicesCount()
+    {
+        std::lock_guard<std::mutex> lock(voicesMutex);
+        return voicesCapacity - freeVoices.size();
+    }
+
+    //! `false` if the voice grid does not fit a work group of the device, the engine then renders silence.
+    bool isReady()
+    {
+        return isGridSupported;
+    }
+
+    DSPBackend getBackend()
+    {
+        return DSPBackendVoices;
+    }
+
+    bool pause()
+    {
+        isPaused = !isPaused;
+        return isPaused;
+    }
+
+    size_t getChannelsCount()
+    {
+        return channelsCount;
+    }
+
+    glm::ivec2 getGridSize()
+    {
+        return glm::ivec2(gridSize.s[0], gridSize.s[1]);
+    }
+
+    size_t getCellsCount()
+    {
+        return cellsCount;
+    }
+
+    //! Voice 0 as of the last block.
+    DSPSampleType4* getCurrentGridState()
+    {
+        return cells;
+    }
+
+    float* getRulesBirthCenter()
+    {
+        return &rules[0];
+    }
+    float* rulesBirthRadius()
+    {
+        return &rules[1];
+    }
+    float* rulesKeepCenter()
+    {
+        return &rules[2];
+    }
+    float* rulesKeepRadius()
+    {
+        return &rules[3];
+    }
+    float* rulesSpeed()
+    {
+        return &rules[4];
+    }
+
+    //! Reseeds voice 0 at the next block.
+    void reseed(uint64_t newSeed)
+    {
+        pendingSeed = newSeed;
+        isSeedDirty = true;
+    }
+
+    uint64_t getSeed()
+    {
+        return isSeedDirty ? pendingSeed : seed;
+    }
+
+    void generateSamples(float* data = NULL)
+    {
+        if (isPaused)
+            return;
+
+        size_t toWrite = _getFramesToWrite();
+        if (toWrite <= 0)
+            return;
+
+        _uploadVoices();
+        _applyVoiceEdits();
+        // the rule controls of voice 0 are written straight from the UI, like the other engines take them every block
+        clEnqueueWriteBuffer(commandQueue, voiceRulesMemoryObj, CL_TRUE, 0, voiceRulesLength * sizeof(cl_float), rules, 0, NULL, NULL);
+        _process(toWrite);
+        clEnqueueReadBuffer(commandQueue, samplesMemoryObj, CL_TRUE, 0, toWrite * sizeof(DSPSampleType), mono.data(), 0, NULL, NULL);
+        if (isGridSupported)
+            _readVoiceCells();
+
+        if (data != NULL)
+        {
+            _readSamples(0, toWrite, data);
+            _shareBlock(data, toWrite);
+            samplesProcessed += toWrite;
+        }
+        else
+        {
+            samplesProcessed += _writeRing(toWrite, channelsCount, samples.data(), [this](size_t offset, size_t count, DSPSampleType* target) { _readSamples(offset, count, target); });
+        }
+        _publishGridSnapshot(toWrite);
+    }
+};
+
+#endif /* DSPVoices_h */
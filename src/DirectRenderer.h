@@ -0,0 +1,172 @@
+//
+//  DirectRenderer.h
+//  GPUDSP
+//
+//  Direct block mode, a worker renders the next audio block while the callback plays the current one.
+//
+
+#ifndef DirectRenderer_h
+#define DirectRenderer_h
+
+#include "DSPEngine.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+struct DirectRendererSettings
+{
+    double          pollInterval = 0.0625;      // part of a block duration the worker sleeps between looks for a played block
+    size_t          fadeFrames = 32;            // crossfade from the concealment back into rendered blocks
+    float           concealDecay = 0.5f;        // gain left after each concealed block
+};
+
+//! Renders fixed blocks of \a engine on its own thread, one block ahead of the audio callback. read never waits and makes
+//! no system call: a block that is not ready when the callback asks is concealed by the last one played backwards and
+//! forwards, so it joins without a step, fading out over consecutive misses, and the next rendered block crossfades back in.
+class DirectRenderer
+{
+protected:
+    DSPEngine*      _engine;
+    DirectRendererSettings _settings;
+    size_t          _frames;
+    size_t          _channels;
+    double          _blockDuration;
+
+    // handed from the worker to the callback, only the side _isReady points to may touch it
+    std::vector<DSPSampleType> _block;
+    std::atomic<bool> _isReady;
+
+    // callback side
+    std::vector<DSPSampleType> _last;
+    size_t          _concealFrame;
+    bool            _isConcealForward;
+    float           _concealGain;
+    bool            _wasConcealed;
+    std::atomic<size_t> _missesCount;
+
+    std::thread     _worker;
+    std::atomic<bool> _isStopping;
+
+    // read only clears _isReady, the worker polls it, so waking the worker never costs the callback a system call
+    void _work()
+    {
+        while (!_isStopping)
+        {
+            if (!_isReady.load(std::memory_order_acquire))
+            {
+                _engine->generateSamples(_block.data());
+                _isReady.store(true, std::memory_order_release);
+                continue;
+            }
+            std::this_thread::sleep_for(std::chrono::duration<double>(_blockDuration * _settings.pollInterval));
+        }
+    }
+
+    // the last block mirrored at both ends, continuing from where the previous frame left off
+    void _conceal(DSPSampleType* data, size_t frames, float fromGain, float toGain)
+    {
+        for (size_t frame = 0; frame < frames; ++frame)
+        {
+            float gain = fromGain + (toGain - fromGain) * (float)frame / (float)frames;
+            for (size_t channel = 0; channel < _channels; ++channel)
+                data[frame * _channels + channel] = _last[_concealFrame * _channels + channel] * gain;
+            _stepConcealment();
+        }
+    }
+
+    void _stepConcealment()
+    {
+        if (_frames < 2)
+            return;
+        if (_isConcealForward ? _concealFrame + 1 == _frames : _concealFrame == 0)
+            _isConcealForward = !_isConcealForward;
+        _concealFrame = _isConcealForward ? _concealFrame + 1 : _concealFrame - 1;
+    }
+
+public:
+    //! Switches \a engine to direct block mode, its blocks are as long as its ring.
+    DirectRenderer(DSPEngine* engine, double sampleRate, const DirectRendererSettings& settings = DirectRendererSettings())
+    {
+        _engine = engine;
+        _settings = settings;
+        _engine->setBlockMode(DSPBlockDirect);
+        _frames = _engine->getRingFrames();
+        _channels = _engine->getChannelsCount();
+        _blockDuration = (double)_frames / sampleRate;
+
+        _block.resize(_frames * _channels);
+        _last.assign(_frames * _channels, 0.0f);
+        _concealFrame = 0;
+        _isConcealForward = false;
+        _concealGain = 1.0f;
+        _wasConcealed = false;
+        _missesCount = 0;
+
+        _isReady = false;
+        _isStopping = false;
+        _worker = std::thread(&DirectRenderer::_work, this);
+    }
+
+    ~DirectRenderer()
+    {
+        _isStopping = true;
+        _worker.join();
+    }
+
+    //! Fills \a data with one block of interleaved frames on the audio thread. \return false if it was concealed.
+    bool read(DSPSampleType* data)
+    {
+        if (!_isReady.load(std::memory_order_acquire))
+        {
+            // a first miss starts backwards from the last frame played, so the join has no step
+            if (!_wasConcealed)
+            {
+                _concealFrame = _frames - 1;
+                _isConcealForward = false;
+                _concealGain = 1.0f;
+            }
+            float gain = _concealGain * _settings.concealDecay;
+            _conceal(data, _frames, _concealGain, gain);
+            _concealGain = gain;
+            _wasConcealed = true;
+            ++_missesCount;
+            return false;
+        }
+
+        std::copy(_block.begin(), _block.end(), data);
+        _isReady.store(false, std::memory_order_release);
+
+        if (_wasConcealed)
+        {
+            size_t fade = std::min(_settings.fadeFrames, _frames);
+            for (size_t frame = 0; frame < fade; ++frame)
+            {
+                float in = (float)(frame + 1) / (float)(fade + 1);
+                for (size_t channel = 0; channel < _channels; ++channel)
+                {
+                    DSPSampleType& sample = data[frame * _channels + channel];
+                    sample = sample * in + _last[_concealFrame * _channels + channel] * _concealGain * (1.0f - in);
+                }
+                _stepConcealment();
+            }
+            _wasConcealed = false;
+        }
+        std::copy(data, data + _frames * _channels, _last.begin());
+        return true;
+    }
+
+    size_t getFrames()
+    {
+        return _frames;
+    }
+
+    //! Blocks concealed because the worker had not finished them in time.
+    size_t getMissesCount()
+    {
+        return _missesCount;
+    }
+};
+
+#endif /* DirectRenderer_h */
@@ -0,0 +1,319 @@
+//
+//  HashLife.h
+//  GPUDSP
+//
+//  Memoized quadtree fast-forward for binary rules on a square power of two torus.
+//
+
+#ifndef HashLife_h
+#define HashLife_h
+
+#include "BinaryAutomaton.h"
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+class HashLife
+{
+protected:
+    struct Node
+    {
+        uint32_t nw, ne, sw, se;
+        uint32_t level;
+    };
+
+    struct NodeKey
+    {
+        uint32_t nw, ne, sw, se;
+
+        bool operator==(const NodeKey& other) const
+        {
+            return nw == other.nw && ne == other.ne && sw == other.sw && se == other.se;
+        }
+    };
+
+    struct NodeKeyHash
+    {
+        size_t operator()(const NodeKey& key) const
+        {
+            uint64_t hash = 0xcbf29ce484222325ull;
+            const uint32_t parts[4] = { key.nw, key.ne, key.sw, key.se };
+            for (uint32_t part : parts)
+            {
+                hash ^= part;
+                hash *= 0x100000001b3ull;
+                hash ^= hash >> 29;
+            }
+            return (size_t)hash;
+        }
+    };
+
+    // leaves 0 and 1 are the dead and alive cells
+    std::vector<Node>                                   _nodes;
+    std::unordered_map<NodeKey, uint32_t, NodeKeyHash>  _index;
+    std::vector<uint32_t>                               _empty;
+    // (node, log2 of generations) -> advanced centre / torus state
+    std::unordered_map<uint64_t, uint32_t>              _results;
+    std::unordered_map<uint64_t, uint32_t>              _torusResults;
+
+    BinaryRule  _rule;
+    uint32_t    _root;
+    uint32_t    _sizeLog2;
+    size_t      _maxNodes;
+
+    static uint64_t _memoKey(uint32_t node, uint32_t generationsLog2)
+    {
+        return ((uint64_t)node << 8) | generationsLog2;
+    }
+
+    uint32_t _join(uint32_t nw, uint32_t ne, uint32_t sw, uint32_t se)
+    {
+        NodeKey key = { nw, ne, sw, se };
+        auto found = _index.find(key);
+        if (found != _index.end())
+            return found->second;
+
+        uint32_t result = (uint32_t)_nodes.size();
+        _nodes.push_back({ nw, ne, sw, se, _nodes[nw].level + 1 });
+        _index.emplace(key, result);
+        return result;
+    }
+
+    uint32_t _emptyNode(uint32_t level)
+    {
+        while (_empty.size() <= level)
+        {
+            uint32_t child = _empty.back();
+            _empty.push_back(_join(child, child, child, child));
+        }
+        return _empty[level];
+    }
+
+    uint32_t _centre(uint32_t node)
+    {
+        const Node& n = _nodes[node];
+        return _join(_nodes[n.nw].se, _nodes[n.ne].sw, _nodes[n.sw].ne, _nodes[n.se].nw);
+    }
+
+    uint32_t _horizontalCentre(uint32_t west, uint32_t east)
+    {
+        const Node& w = _nodes[west];
+        const Node& e = _nodes[east];
+        return _join(w.ne, e.nw, w.se, e.sw);
+    }
+
+    uint32_t _verticalCentre(uint32_t north, uint32_t south)
+    {
+        const Node& n = _nodes[north];
+        const Node& s = _nodes[south];
+        return _join(n.sw, n.se, s.nw, s.ne);
+    }
+
+    bool _cell(uint32_t node, uint32_t x, uint32_t y)
+    {
+        // x runs south, y runs east, same as the engine's (x * height + y) layout
+        while (_nodes[node].level > 0)
+        {
+            uint32_t half = 1u << (_nodes[node].level - 1);
+            const Node& n = _nodes[node];
+            bool south = x >= half;
+            bool east = y >= half;
+            node = south ? (east ? n.se : n.sw) : (east ? n.ne : n.nw);
+            x -= south ? half : 0;
+            y -= east ? half : 0;
+        }
+        return node == 1;
+    }
+
+    // level 2 node, centre 2x2 after one generation
+    uint32_t _baseStep(uint32_t node)
+    {
+        bool cells[4][4];
+        for (uint32_t x = 0; x < 4; ++x)
+            for (uint32_t y = 0; y < 4; ++y)
+                cells[x][y] = _cell(node, x, y);
+
+        uint32_t next[2][2];
+        for (uint32_t x = 1; x < 3; ++x)
+        {
+            for (uint32_t y = 1; y < 3; ++y)
+            {
+                uint32_t sum = 0;
+                for (int i = -1; i <= 1; ++i)
+                    for (int j = -1; j <= 1; ++j)
+                        sum += (i != 0 || j != 0) && cells[x + i][y + j] ? 1 : 0;
+
+                uint32_t mask = cells[x][y] ? _rule.keepMask : _rule.birthMask;
+                next[x - 1][y - 1] = (mask >> sum) & 1;
+            }
+        }
+        return _join(next[0][0], next[0][1], next[1][0], next[1][1]);
+    }
+
+    //! Centre half of \a node advanced by 2^generationsLog2 generations, generationsLog2 <= level - 2.
+    uint32_t _successor(uint32_t node, uint32_t generationsLog2)
+    {
+        uint32_t level = _nodes[node].level;
+        // empty space stays empty unless cells are born with no neighbours
+        if ((_rule.birthMask & 1) == 0 && node == _emptyNode(level))
+            return _emptyNode(level - 1);
+
+        uint64_t key = _memoKey(node, generationsLog2);
+        auto found = _results.find(key);
+        if (found != _results.end())
+            return found->second;
+
+        uint32_t result;
+        if (level == 2)
+        {
+            result = _baseStep(node);
+        }
+        else
+        {
+            const Node n = _nodes[node];
+            bool fullSpeed = generationsLog2 == level - 2;
+
+            // nine overlapping level - 1 subnodes
+            uint32_t sub[3][3] =
+            {
+                { n.nw, _horizontalCentre(n.nw, n.ne), n.ne },
+                { _verticalCentre(n.nw, n.sw), _centre(node), _verticalCentre(n.ne, n.se) },
+                { n.sw, _horizontalCentre(n.sw, n.se), n.se }
+            };
+
+            uint32_t half[3][3];
+            for (int i = 0; i < 3; ++i)
+                for (int j = 0; j < 3; ++j)
+                    half[i][j] = fullSpeed ? _successor(sub[i][j], level - 3) : _centre(sub[i][j]);
+
+            uint32_t stepLog2 = fullSpeed ? level - 3 : generationsLog2;
+            result = _join(_successor(_join(half[0][0], half[0][1], half[1][0], half[1][1]), stepLog2),
+                           _successor(_join(half[0][1], half[0][2], half[1][1], half[1][2]), stepLog2),
+                           _successor(_join(half[1][0], half[1][1], half[2][0], half[2][1]), stepLog2),
+                           _successor(_join(half[1][1], half[1][2], half[2][1], half[2][2]), stepLog2));
+        }
+
+        _results.emplace(key, result);
+        return result;
+    }
+
+    //! Whole torus \a grid advanced by 2^generationsLog2 generations.
+    uint32_t _advanceTorus(uint32_t grid, uint32_t generationsLog2)
+    {
+        uint64_t key = _memoKey(grid, generationsLog2);
+        auto found = _torusResults.find(key);
+        if (found != _torusResults.end())
+            return found->second;
+
+        uint32_t result;
+        if (generationsLog2 + 1 <= _sizeLog2)
+        {
+            // the periodic tiling evolves like the torus, its centre is the grid shifted by half a period
+            uint32_t centre = _successor(_join(grid, grid, grid, grid), generationsLog2);
+            const Node& c = _nodes[centre];
+            result = _join(c.se, c.sw, c.ne, c.nw);
+        }
+        else
+        {
+            result = _advanceTorus(_advanceTorus(grid, generationsLog2 - 1), generationsLog2 - 1);
+        }
+
+        _torusResults.emplace(key, result);
+        return result;
+    }
+
+    template <typename Getter> uint32_t _build(uint32_t level, uint32_t x, uint32_t y, Getter& isAlive)
+    {
+        if (level == 0)
+            return isAlive(x, y) ? 1 : 0;
+
+        uint32_t half = 1u << (level - 1);
+        return _join(_build(level - 1, x, y, isAlive), _build(level - 1, x, y + half, isAlive),
+                     _build(level - 1, x + half, y, isAlive), _build(level - 1, x + half, y + half, isAlive));
+    }
+
+    template <typename Setter> void _store(uint32_t node, uint32_t x, uint32_t y, Setter& setAlive)
+    {
+        uint32_t level = _nodes[node].level;
+        if (level == 0)
+        {
+            setAlive(x, y, node == 1);
+            return;
+        }
+
+        const Node n = _nodes[node];
+        uint32_t half = 1u << (level - 1);
+        _store(n.nw, x, y, setAlive);
+        _store(n.ne, x, y + half, setAlive);
+        _store(n.sw, x + half, y, setAlive);
+        _store(n.se, x + half, y + half, setAlive);
+    }
+
+    void _reset()
+    {
+        _nodes.clear();
+        _index.clear();
+        _results.clear();
+        _torusResults.clear();
+        _nodes.push_back({ 0, 0, 0, 0, 0 });
+        _nodes.push_back({ 1, 1, 1, 1, 0 });
+        _empty.assign(1, 0);
+    }
+
+public:
+    //! \a maxNodes bounds the memo, it is flushed before a load when exceeded.
+    HashLife(size_t maxNodes = 1 << 22) : _root(0), _sizeLog2(0), _maxNodes(maxNodes)
+    {
+        _reset();
+    }
+
+    //! Returns `true` if \a size is a power of two this engine can advance.
+    static bool supportsSize(size_t width, size_t height)
+    {
+        return width == height && width >= 8 && (width & (width - 1)) == 0 && width <= (1u << 30);
+    }
+
+    void setRule(const BinaryRule& rule)
+    {
+        if (rule == _rule)
+            return;
+        _rule = rule;
+        _results.clear();
+        _torusResults.clear();
+    }
+
+    //! Takes a \a size x \a size snapshot through isAlive(x, y). \return `false` if the size is unsupported.
+    template <typename Getter> bool load(size_t size, Getter isAlive)
+    {
+        if (!supportsSize(size, size))
+            return false;
+
+        if (_nodes.size() > _maxNodes)
+            _reset();
+
+        _sizeLog2 = 0;
+        while ((1u << _sizeLog2) < size)
+            ++_sizeLog2;
+        _root = _build(_sizeLog2, 0, 0, isAlive);
+        return true;
+    }
+
+    //! Advances the loaded grid by 2^generationsLog2 generations.
+    void advance(uint32_t generationsLog2)
+    {
+        _root = _advanceTorus(_root, generationsLog2);
+    }
+
+    //! Writes the current grid through setAlive(x, y, alive).
+    template <typename Setter> void store(Setter setAlive)
+    {
+        _store(_root, 0, 0, setAlive);
+    }
+
+    size_t getNodesCount() const
+    {
+        return _nodes.size();
+    }
+};
+
+#endif /* HashLife_h */
@@ -0,0 +1,205 @@
+//
+//  LatencyTuner.h
+//  GPUDSP
+//
+//  Keeps the ring fill level, the output latency, as low as the measured render cost and call jitter allow.
+//
+
+#ifndef LatencyTuner_h
+#define LatencyTuner_h
+
+#include "DSPEngine.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+
+struct LatencyTunerSettings
+{
+    double          latencyTarget = 0.02;       // seconds of output latency asked for, also the fill before anything is measured
+    double          underrunProbability = 1e-3; // chance per refill that the ring runs dry the fill is sized for
+    size_t          audioBlock = 512;           // frames the audio callback takes at once
+    size_t          retuneInterval = 32;        // refills between two fill changes
+    double          decay = 0.05;               // weight of the newest refill in the running statistics
+};
+
+//! Models a refill as cost = overhead + perFrame * frames after a call interval with running mean and variance.
+//! The ring has to outlast the interval and the next refill, so the fill is the smallest one whose Gaussian
+//! tail probability of running dry stays under the target. It grows at once, shrinks a quarter of the way per retune,
+//! and on every underrun the audio callback reports grows by the frames it was short, at least by a quarter.
+class LatencyTuner
+{
+protected:
+    LatencyTunerSettings _settings;
+    double          _sampleRate;
+    size_t          _capacity;
+    size_t          _fill;
+
+    // exponentially weighted least squares sums of (frames, seconds)
+    double          _weight;
+    double          _frames;
+    double          _seconds;
+    double          _framesSquared;
+    double          _framesSeconds;
+
+    double          _intervalMean;
+    double          _intervalVariance;
+    bool            _hasStart;
+    std::chrono::steady_clock::time_point _lastStart;
+
+    size_t          _refills;
+    size_t          _underruns;
+    size_t          _shortfall;
+
+    void _observe(size_t frames, double seconds, double interval)
+    {
+        double keep = 1.0 - _settings.decay;
+        double x = (double)frames;
+        _weight = keep * _weight + 1.0;
+        _frames = keep * _frames + x;
+        _seconds = keep * _seconds + seconds;
+        _framesSquared = keep * _framesSquared + x * x;
+        _framesSeconds = keep * _framesSeconds + x * seconds;
+
+        if (interval > 0.0)
+        {
+            double delta = interval - _intervalMean;
+            _intervalMean += _settings.decay * delta;
+            _intervalVariance = keep * (_intervalVariance + _settings.decay * delta * delta);
+        }
+    }
+
+    void _retune()
+    {
+        double perFrame = getCostPerFrame();
+        double overhead = getCostOverhead();
+        double load = perFrame * _sampleRate;
+        size_t needed = _capacity;
+        if (load < 0.95)
+        {
+            // frames = sampleRate * (interval + overhead + perFrame * frames), solved for frames
+            double gap = _intervalMean + normalQuantile(_settings.underrunProbability) * sqrt(_intervalVariance) + overhead;
+            needed = (size_t)ceil(_sampleRate * gap / (1.0 - load)) + _settings.audioBlock;
+        }
+        needed = std::min(_capacity, std::max(needed, _minimumFill()));
+
+        if (needed >= _fill)
+            _fill = needed;
+        else
+            _fill -= (_fill - needed) / 4;
+    }
+
+    size_t _minimumFill()
+    {
+        return std::min(_capacity, _settings.audioBlock * 2);
+    }
+
+public:
+    LatencyTuner(double sampleRate, size_t capacity, const LatencyTunerSettings& settings = LatencyTunerSettings()) :
+    _settings(settings),
+    _sampleRate(sampleRate),
+    _capacity(capacity),
+    _weight(0.0),
+    _frames(0.0),
+    _seconds(0.0),
+    _framesSquared(0.0),
+    _framesSeconds(0.0),
+    _intervalMean(0.0),
+    _intervalVariance(0.0),
+    _hasStart(false),
+    _refills(0),
+    _underruns(0),
+    _shortfall(0)
+    {
+        _fill = std::min(_capacity, std::max((size_t)(_settings.latencyTarget * _sampleRate), _minimumFill()));
+    }
+
+    //! z with P(Z > z) = \a probability for a standard normal Z, Newton steps on the complementary error function.
+    static double normalQuantile(double probability)
+    {
+        probability = std::min(0.5, std::max(probability, 1e-12));
+        double z = sqrt(-2.0 * log(probability));
+        for (int i = 0; i < 32; ++i)
+        {
+            double error = 0.5 * erfc(z / sqrt(2.0)) - probability;
+            double density = exp(-0.5 * z * z) / sqrt(2.0 * M_PI);
+            double step = error / density;
+            z += step;
+            if (fabs(step) < 1e-9)
+                break;
+        }
+        return z;
+    }
+
+    //! Refills \a engine, times the call and applies a new fill level when one is due. Call it from the render loop
+    //! in place of generateSamples.
+    template <typename Engine>
+    void generate(Engine* engine)
+    {
+        auto start = std::chrono::steady_clock::now();
+        double interval = _hasStart ? std::chrono::duration<double>(start - _lastStart).count() : 0.0;
+        _lastStart = start;
+        _hasStart = true;
+
+        engine->setRingFill(_fill);
+        engine->generateSamples();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        _observe(engine->getBlockFrames(), seconds, interval);
+
+#if LOGENABLED
+        size_t fill = _fill;
+#endif
+        size_t underruns = engine->getUnderrunsCount();
+        size_t shortfall = engine->getShortfallFrames();
+        if (underruns != _underruns)
+        {
+            _fill = std::min(_capacity, _fill + std::max(shortfall - _shortfall, _fill / 4));
+            _underruns = underruns;
+            _shortfall = shortfall;
+            _refills = 0;
+        }
+        else if (++_refills >= _settings.retuneInterval)
+        {
+            _retune();
+            _refills = 0;
+        }
+#if LOGENABLED
+        if (_fill != fill)
+            std::cout << "[Latency]: fill " << _fill << " frames, " << getLatency() * 1000.0 << " ms" << std::endl;
+#endif
+    }
+
+    size_t getFill()
+    {
+        return _fill;
+    }
+
+    double getLatency()
+    {
+        return (double)_fill / _sampleRate;
+    }
+
+    bool isWithinTarget()
+    {
+        return getLatency() <= _settings.latencyTarget;
+    }
+
+    //! Seconds per rendered frame, the slope of the fit, or the mean cost per frame while block lengths barely vary.
+    double getCostPerFrame()
+    {
+        double determinant = _weight * _framesSquared - _frames * _frames;
+        if (determinant > 1e-6 * _weight * _framesSquared)
+            return std::max(0.0, (_weight * _framesSeconds - _frames * _seconds) / determinant);
+        return _frames > 0.0 ? _seconds / _frames : 0.0;
+    }
+
+    //! Seconds a refill costs whatever its length.
+    double getCostOverhead()
+    {
+        if (_weight == 0.0)
+            return 0.0;
+        return std::max(0.0, (_seconds - getCostPerFrame() * _frames) / _weight);
+    }
+};
+
+#endif /* LatencyTuner_h */
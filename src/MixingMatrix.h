@@ -0,0 +1,226 @@
+//
+//  MixingMatrix.h
+//  GPUDSP
+//
+//  Weights from every cell to every output channel, with spatial presets.
+//
+
+#ifndef MixingMatrix_h
+#define MixingMatrix_h
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+enum MixingPreset
+{
+    MixingMean,         // one channel, the mean state of the grid, what the mono mixdown plays
+    MixingStereo,       // left and right, cells panned at equal power by their x
+    MixingQuad,         // front left, front right, rear left, rear right, panned by x and y
+    MixingAmbisonic,    // first order B-format in ACN order with SN3D weights (W, Y, Z, X), x is the azimuth and y the elevation
+    MixingCustom        // weights given by the user
+};
+
+//! frame[c] = sum over cells of weight[c][i] * (2 * state[i] - 1), so a dead cell pulls a channel down and a live one pushes it up
+//! like in the mono mixdown. Weights are kept folded as 2 * weight and an offset of -sum(weight) per channel.
+class MixingMatrix
+{
+protected:
+    size_t              _width;
+    size_t              _height;
+    size_t              _channelsCount;
+    MixingPreset        _preset;
+    std::vector<float>  _weights;
+    std::vector<float>  _offsets;
+
+    void _fold(const std::vector<float>& weights)
+    {
+        size_t cellsCount = getCellsCount();
+        _weights.resize(weights.size());
+        _offsets.assign(_channelsCount, 0.0f);
+        for (size_t channel = 0; channel < _channelsCount; ++channel)
+        {
+            for (size_t i = channel * cellsCount; i < (channel + 1) * cellsCount; ++i)
+            {
+                _weights[i] = 2.0f * weights[i];
+                _offsets[channel] -= weights[i];
+            }
+        }
+    }
+
+    // scales every channel so its weights add up to one, a full grid then plays 1 and an empty one -1 on each
+    static void _normalize(std::vector<float>& weights, size_t channelsCount)
+    {
+        size_t cellsCount = weights.size() / channelsCount;
+        for (size_t channel = 0; channel < channelsCount; ++channel)
+        {
+            float sum = 0.0f;
+            for (size_t i = channel * cellsCount; i < (channel + 1) * cellsCount; ++i)
+                sum += weights[i];
+            for (size_t i = channel * cellsCount; i < (channel + 1) * cellsCount && sum > 0.0f; ++i)
+                weights[i] /= sum;
+        }
+    }
+
+public:
+    MixingMatrix(size_t width, size_t height, MixingPreset preset = MixingMean) : _width(width), _height(height)
+    {
+        if (!setPreset(preset))
+            setPreset(MixingMean);
+    }
+
+    //! \return 0 for MixingCustom, which takes any count.
+    static size_t presetChannelsCount(MixingPreset preset)
+    {
+        switch (preset)
+        {
+            case MixingMean:
+                return 1;
+            case MixingStereo:
+                return 2;
+            case MixingQuad:
+            case MixingAmbisonic:
+                return 4;
+            default:
+                return 0;
+        }
+    }
+
+    //! \return `false` for MixingCustom, use setWeights.
+    bool setPreset(MixingPreset preset)
+    {
+        size_t channelsCount = presetChannelsCount(preset);
+        if (channelsCount == 0)
+            return false;
+
+        size_t cellsCount = getCellsCount();
+        std::vector<float> weights(channelsCount * cellsCount, 1.0f);
+        for (size_t x = 0; x < _width; ++x)
+        {
+            float u = ((float)x + 0.5f) / (float)_width;
+            for (size_t y = 0; y < _height; ++y)
+            {
+                float v = ((float)y + 0.5f) / (float)_height;
+                size_t i = x * _height + y;
+                if (preset == MixingStereo || preset == MixingQuad)
+                {
+                    float left = cosf(u * (float)M_PI_2);
+                    float right = sinf(u * (float)M_PI_2);
+                    float front = preset == MixingQuad ? cosf(v * (float)M_PI_2) : 1.0f;
+                    float rear = sinf(v * (float)M_PI_2);
+                    weights[i] = left * front;
+                    weights[cellsCount + i] = right * front;
+                    if (preset == MixingQuad)
+                    {
+                        weights[2 * cellsCount + i] = left * rear;
+                        weights[3 * cellsCount + i] = right * rear;
+                    }
+                }
+                else if (preset == MixingAmbisonic)
+                {
+                    float azimuth = u * 2.0f * (float)M_PI;
+                    float elevation = (v - 0.5f) * (float)M_PI;
+                    float scale = 1.0f / (float)cellsCount;
+                    weights[i] = scale;
+                    weights[cellsCount + i] = sinf(azimuth) * cosf(elevation) * scale;
+                    weights[2 * cellsCount + i] = sinf(elevation) * scale;
+                    weights[3 * cellsCount + i] = cosf(azimuth) * cosf(elevation) * scale;
+                }
+            }
+        }
+        if (preset != MixingAmbisonic)
+            _normalize(weights, channelsCount);
+
+        _channelsCount = channelsCount;
+        _preset = preset;
+        _fold(weights);
+        return true;
+    }
+
+    //! The preset made for \a channelsCount channels, or the mean on every channel for counts without one.
+    void setChannels(size_t channelsCount)
+    {
+        for (MixingPreset preset : { MixingMean, MixingStereo, MixingQuad })
+            if (presetChannelsCount(preset) == channelsCount && setPreset(preset))
+                return;
+
+        setWeights(channelsCount, std::vector<float>(channelsCount * getCellsCount(), 1.0f / (float)getCellsCount()));
+    }
+
+    //! \a weights holds getCellsCount() weights per channel, channel after channel. \return `false` if the size does not match.
+    bool setWeights(size_t channelsCount, const std::vector<float>& weights)
+    {
+        if (channelsCount == 0 || weights.size() != channelsCount * getCellsCount())
+            return false;
+
+        _channelsCount = channelsCount;
+        _preset = MixingCustom;
+        _fold(weights);
+        return true;
+    }
+
+    size_t getCellsCount() const
+    {
+        return _width * _height;
+    }
+
+    size_t getChannelsCount() const
+    {
+        return _channelsCount;
+    }
+
+    MixingPreset getPreset() const
+    {
+        return _preset;
+    }
+
+    //! `true` for the plain mean, which the mono mixdown already computes.
+    bool isMean() const
+    {
+        return _preset == MixingMean;
+    }
+
+    //! Folded weights, getCellsCount() per channel, applied to the states as they are.
+    const float* getWeights() const
+    {
+        return _weights.data();
+    }
+
+    const float* getOffsets() const
+    {
+        return _offsets.data();
+    }
+
+    //! The weights in the form setWeights takes them.
+    std::vector<float> getUserWeights() const
+    {
+        std::vector<float> weights(_weights.size());
+        for (size_t i = 0; i < weights.size(); ++i)
+            weights[i] = 0.5f * _weights[i];
+        return weights;
+    }
+
+    //! One interleaved frame of getChannelsCount() samples from a plane of cell states.
+    void mix(const float* state, float* frame) const
+    {
+        size_t cellsCount = getCellsCount();
+        for (size_t channel = 0; channel < _channelsCount; ++channel)
+        {
+            // independent partial sums, so the compiler can keep them in vector lanes without reassociating
+            const float* weights = &_weights[channel * cellsCount];
+            float lanes[8] = { 0.0f };
+            size_t i = 0;
+            for (; i + 8 <= cellsCount; i += 8)
+                for (size_t lane = 0; lane < 8; ++lane)
+                    lanes[lane] += weights[i + lane] * state[i + lane];
+            float sum = 0.0f;
+            for (; i < cellsCount; ++i)
+                sum += weights[i] * state[i];
+            for (size_t lane = 0; lane < 8; ++lane)
+                sum += lanes[lane];
+            frame[channel] = sum + _offsets[channel];
+        }
+    }
+};
+
+#endif /* MixingMatrix_h */
@@ -0,0 +1,140 @@
+//
+//  Neighbourhood.h
+//  GPUDSP
+//
+//  Square and cross neighbourhoods of any radius summed by separable running sums.
+//
+
+#ifndef Neighbourhood_h
+#define Neighbourhood_h
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+enum NeighbourhoodShape
+{
+    NeighbourhoodSquare,    // (2r + 1)^2 - 1 cells, Moore for r = 1
+    NeighbourhoodCross      // 4r cells on the row and column of the cell, von Neumann for r = 1
+};
+
+enum BoundaryMode
+{
+    BoundaryTorus,      // opposite edges are neighbours
+    BoundaryClamp,      // cells past an edge repeat the edge cell
+    BoundaryReflect,    // cells past an edge mirror the grid around the edge cell
+    BoundaryFixed       // cells past an edge hold a constant value
+};
+
+//! Interior index standing in for \a index on an axis of \a size cells, -1 for the constant of BoundaryFixed. Valid within one axis length of the grid.
+inline int boundaryIndex(int index, int size, BoundaryMode mode)
+{
+    if (index >= 0 && index < size)
+        return index;
+
+    switch (mode)
+    {
+        case BoundaryClamp:
+            return index < 0 ? 0 : size - 1;
+        case BoundaryReflect:
+            return std::min(std::max(index < 0 ? -index : 2 * size - 2 - index, 0), size - 1);
+        case BoundaryFixed:
+            return -1;
+        default:
+            return index < 0 ? index + size : index - size;
+    }
+}
+
+struct Neighbourhood
+{
+    NeighbourhoodShape  shape;
+    uint32_t            radius;
+
+    Neighbourhood(NeighbourhoodShape initShape = NeighbourhoodSquare, uint32_t initRadius = 1) : shape(initShape), radius(initRadius) {}
+
+    uint32_t getCellsCount() const
+    {
+        return shape == NeighbourhoodSquare ? (2 * radius + 1) * (2 * radius + 1) - 1 : 4 * radius;
+    }
+
+    //! The radius 1 Moore neighbourhood evaluated by the Cells.ncl stencil.
+    bool isStencil() const
+    {
+        return shape == NeighbourhoodSquare && radius == 1;
+    }
+
+    bool operator==(const Neighbourhood& other) const
+    {
+        return shape == other.shape && radius == other.radius;
+    }
+
+    bool operator!=(const Neighbourhood& other) const
+    {
+        return !(*this == other);
+    }
+};
+
+//! Toroidal neighbour sums at O(1) per cell: a running sum along each row, then one along each column.
+//! Sums are scaled by \a scale / cells count so that rules written for another neighbourhood size keep their meaning.
+class WindowSumsCPU
+{
+protected:
+    size_t              _width;
+    size_t              _height;
+    std::vector<float>  _rowSums;
+    std::vector<float>  _columnWindow;
+
+public:
+    WindowSumsCPU(size_t width, size_t height) : _width(width), _height(height), _rowSums(width * height), _columnWindow(height) {}
+
+    //! Radius is clamped below half the shorter side so the window never wraps onto itself.
+    static uint32_t clampRadius(uint32_t radius, size_t width, size_t height)
+    {
+        return std::max<uint32_t>(1, std::min<uint32_t>(radius, (uint32_t)((std::min(width, height) - 1) / 2)));
+    }
+
+    void compute(const float* state, float* sums, const Neighbourhood& neighbourhood, float scale)
+    {
+        int radius = (int)clampRadius(neighbourhood.radius, _width, _height);
+        bool cross = neighbourhood.shape == NeighbourhoodCross;
+        float normalization = scale / (float)Neighbourhood(neighbourhood.shape, radius).getCellsCount();
+
+        for (size_t x = 0; x < _width; ++x)
+        {
+            const float* row = state + x * _height;
+            float sum = 0.0f;
+            for (int d = -radius; d <= radius; ++d)
+                sum += row[(d + _height) % _height];
+            for (size_t y = 0; y < _height; ++y)
+            {
+                _rowSums[x * _height + y] = sum;
+                sum += row[(y + radius + 1) % _height] - row[(y + _height - radius) % _height];
+            }
+        }
+
+        // the column window runs over row sums for squares and over the cells themselves for crosses
+        const float* columns = cross ? state : _rowSums.data();
+        std::fill(_columnWindow.begin(), _columnWindow.end(), 0.0f);
+        for (int d = -radius; d <= radius; ++d)
+        {
+            const float* source = columns + ((d + _width) % _width) * _height;
+            for (size_t y = 0; y < _height; ++y)
+                _columnWindow[y] += source[y];
+        }
+
+        for (size_t x = 0; x < _width; ++x)
+        {
+            const float* entering = columns + ((x + radius + 1) % _width) * _height;
+            const float* leaving = columns + ((x + _width - radius) % _width) * _height;
+            for (size_t y = 0; y < _height; ++y)
+            {
+                size_t i = x * _height + y;
+                float sum = cross ? _rowSums[i] + _columnWindow[y] - 2.0f * state[i] : _columnWindow[y] - state[i];
+                sums[i] = sum * normalization;
+                _columnWindow[y] += entering[y] - leaving[y];
+            }
+        }
+    }
+};
+
+#endif /* Neighbourhood_h */
@@ -0,0 +1,253 @@
+//
+//  OpenCLUtils.h
+//  GPUDSP
+//
+//  Context, program and error helpers shared by the OpenCL engines.
+//
+
+#ifndef OpenCLUtils_h
+#define OpenCLUtils_h
+
+#include "Utils.h"
+#include <OpenCL/OpenCL.h>
+#include "cinder/app/cocoa/PlatformCocoa.h"
+#include <string>
+#include <vector>
+
+inline const char* getCLErrorString(cl_int error)
+{
+    switch(error)
+    {
+        // run-time and JIT compiler errors
+        case 0: return "CL_SUCCESS";
+        case -1: return "CL_DEVICE_NOT_FOUND";
+        case -2: return "CL_DEVICE_NOT_AVAILABLE";
+        case -3: return "CL_COMPILER_NOT_AVAILABLE";
+        case -4: return "CL_MEM_OBJECT_ALLOCATION_FAILURE";
+        case -5: return "CL_OUT_OF_RESOURCES";
+        case -6: return "CL_OUT_OF_HOST_MEMORY";
+        case -7: return "CL_PROFILING_INFO_NOT_AVAILABLE";
+        case -8: return "CL_MEM_COPY_OVERLAP";
+        case -9: return "CL_IMAGE_FORMAT_MISMATCH";
+        case -10: return "CL_IMAGE_FORMAT_NOT_SUPPORTED";
+        case -11: return "CL_BUILD_PROGRAM_FAILURE";
+        case -12: return "CL_MAP_FAILURE";
+        case -13: return "CL_MISALIGNED_SUB_BUFFER_OFFSET";
+        case -14: return "CL_EXEC_STATUS_ERROR_FOR_EVENTS_IN_WAIT_LIST";
+        case -15: return "CL_COMPILE_PROGRAM_FAILURE";
+        case -16: return "CL_LINKER_NOT_AVAILABLE";
+        case -17: return "CL_LINK_PROGRAM_FAILURE";
+        case -18: return "CL_DEVICE_PARTITION_FAILED";
+        case -19: return "CL_KERNEL_ARG_INFO_NOT_AVAILABLE";
+            
+        // compile-time errors
+        case -30: return "CL_INVALID_VALUE";
+        case -31: return "CL_INVALID_DEVICE_TYPE";
+        case -32: return "CL_INVALID_PLATFORM";
+        case -33: return "CL_INVALID_DEVICE";
+        case -34: return "CL_INVALID_CONTEXT";
+        case -35: return "CL_INVALID_QUEUE_PROPERTIES";
+        case -36: return "CL_INVALID_COMMAND_QUEUE";
+        case -37: return "CL_INVALID_HOST_PTR";
+        case -38: return "CL_INVALID_MEM_OBJECT";
+        case -39: return "CL_INVALID_IMAGE_FORMAT_DESCRIPTOR";
+        case -40: return "CL_INVALID_IMAGE_SIZE";
+        case -41: return "CL_INVALID_SAMPLER";
+        case -42: return "CL_INVALID_BINARY";
+        case -43: return "CL_INVALID_BUILD_OPTIONS";
+        case -44: return "CL_INVALID_PROGRAM";
+        case -45: return "CL_INVALID_PROGRAM_EXECUTABLE";
+        case -46: return "CL_INVALID_KERNEL_NAME";
+        case -47: return "CL_INVALID_KERNEL_DEFINITION";
+        case -48: return "CL_INVALID_KERNEL";
+        case -49: return "CL_INVALID_ARG_INDEX";
+        case -50: return "CL_INVALID_ARG_VALUE";
+        case -51: return "CL_INVALID_ARG_SIZE";
+        case -52: return "CL_INVALID_KERNEL_ARGS";
+        case -53: return "CL_INVALID_WORK_DIMENSION";
+        case -54: return "CL_INVALID_WORK_GROUP_SIZE";
+        case -55: return "CL_INVALID_WORK_ITEM_SIZE";
+        case -56: return "CL_INVALID_GLOBAL_OFFSET";
+        case -57: return "CL_INVALID_EVENT_WAIT_LIST";
+        case -58: return "CL_INVALID_EVENT";
+        case -59: return "CL_INVALID_OPERATION";
+        case -60: return "CL_INVALID_GL_OBJECT";
+        case -61: return "CL_INVALID_BUFFER_SIZE";
+        case -62: return "CL_INVALID_MIP_LEVEL";
+        case -63: return "CL_INVALID_GLOBAL_WORK_SIZE";
+        case -64: return "CL_INVALID_PROPERTY";
+        case -65: return "CL_INVALID_IMAGE_DESCRIPTOR";
+        case -66: return "CL_INVALID_COMPILER_OPTIONS";
+        case -67: return "CL_INVALID_LINKER_OPTIONS";
+        case -68: return "CL_INVALID_DEVICE_PARTITION_COUNT";
+            
+        // extension errors
+        case -1000: return "CL_INVALID_GL_SHAREGROUP_REFERENCE_KHR";
+        case -1001: return "CL_PLATFORM_NOT_FOUND_KHR";
+        case -1002: return "CL_INVALID_D3D10_DEVICE_KHR";
+        case -1003: return "CL_INVALID_D3D10_RESOURCE_KHR";
+        case -1004: return "CL_D3D10_RESOURCE_ALREADY_ACQUIRED_KHR";
+        case -1005: return "CL_D3D10_RESOURCE_NOT_ACQUIRED_KHR";
+        default: return "Unknown OpenCL error";
+    }
+}
+
+inline void logCLError(cl_int error)
+{
+#if LOGENABLED
+    std::cerr << "[OpenCL error]: " << getCLErrorString(error) << std::endl;
+#endif
+}
+
+struct CLDevice
+{
+    cl_device_id    deviceID;
+    cl_device_type  type;
+    std::string     name;
+    std::string     platform;
+    std::string     driver;
+};
+
+inline std::string getCLDeviceString(cl_device_id deviceID, cl_device_info info)
+{
+    size_t length = 0;
+    if (clGetDeviceInfo(deviceID, info, 0, NULL, &length) != CL_SUCCESS || length == 0)
+        return std::string();
+    std::vector<char> value(length);
+    clGetDeviceInfo(deviceID, info, length, value.data(), NULL);
+    return std::string(value.data());
+}
+
+//! Every device of every platform, GPUs, CPUs and accelerators alike, in platform order.
+inline std::vector<CLDevice> listCLDevices()
+{
+    std::vector<CLDevice> devices;
+    cl_uint numPlatforms = 0;
+    if (clGetPlatformIDs(0, NULL, &numPlatforms) != CL_SUCCESS || numPlatforms == 0)
+        return devices;
+    std::vector<cl_platform_id> platforms(numPlatforms);
+    clGetPlatformIDs(numPlatforms, platforms.data(), NULL);
+    
+    for (cl_platform_id platformID : platforms)
+    {
+        char platformName[256] = { 0 };
+        clGetPlatformInfo(platformID, CL_PLATFORM_NAME, sizeof(platformName) - 1, platformName, NULL);
+        
+        cl_uint numDevices = 0;
+        if (clGetDeviceIDs(platformID, CL_DEVICE_TYPE_ALL, 0, NULL, &numDevices) != CL_SUCCESS || numDevices == 0)
+            continue;
+        std::vector<cl_device_id> platformDevices(numDevices);
+        clGetDeviceIDs(platformID, CL_DEVICE_TYPE_ALL, numDevices, platformDevices.data(), NULL);
+        
+        for (cl_device_id deviceID : platformDevices)
+        {
+            CLDevice device;
+            device.deviceID = deviceID;
+            device.type = 0;
+            clGetDeviceInfo(deviceID, CL_DEVICE_TYPE, sizeof(cl_device_type), &device.type, NULL);
+            device.name = getCLDeviceString(deviceID, CL_DEVICE_NAME);
+            device.platform = platformName;
+            device.driver = getCLDeviceString(deviceID, CL_DRIVER_VERSION);
+            devices.push_back(device);
+        }
+    }
+    return devices;
+}
+
+//! Whether prepareCLContext will find any device, without creating anything.
+inline bool hasCLDevice()
+{
+    return !listCLDevices().empty();
+}
+
+// device the next prepareCLContext builds on, NULL takes the first GPU, or the first device if there is none
+inline cl_device_id& selectedCLDevice()
+{
+    static cl_device_id device = NULL;
+    return device;
+}
+
+//! Makes every engine created afterwards use \a deviceID, see selectCLDevice in CLDeviceSelector.h.
+inline void setCLDevice(cl_device_id deviceID)
+{
+    selectedCLDevice() = deviceID;
+}
+
+//! Context and in-order queue on the selected device.
+inline void prepareCLContext(cl_device_id& deviceID, cl_context& context, cl_command_queue& commandQueue)
+{
+    cl_int ret = CL_SUCCESS;
+    deviceID = selectedCLDevice();
+    if (deviceID == NULL)
+    {
+        std::vector<CLDevice> devices = listCLDevices();
+        for (const CLDevice& device : devices)
+        {
+            if (device.type & CL_DEVICE_TYPE_GPU)
+            {
+                deviceID = device.deviceID;
+                break;
+            }
+        }
+        if (deviceID == NULL && !devices.empty())
+            deviceID = devices.front().deviceID;
+        if (deviceID == NULL)
+            logCLError(CL_DEVICE_NOT_FOUND);
+    }
+    
+#if LOGENABLED
+    size_t extInfoSize = 0;
+    clGetDeviceInfo(deviceID, CL_DEVICE_EXTENSIONS, NULL, NULL, &extInfoSize);
+    logCLError(ret);
+    char* info = new char[extInfoSize];
+    clGetDeviceInfo(deviceID, CL_DEVICE_EXTENSIONS, extInfoSize, info, NULL);
+    logCLError(ret);
+    std::cout << "[OpenCL SUPPORTED EXTENSIONS] : " << info << std::endl;
+    delete [] info;
+#endif
+    
+    context = clCreateContext(NULL, 1, &deviceID, NULL, NULL, &ret);
+    logCLError(ret);
+    
+    commandQueue = clCreateCommandQueue(context, deviceID, 0, &ret);
+    logCLError(ret);
+}
+
+//! Builds a .ncl file from the app resources and creates \a kernels from it, the program itself is released.
+//! \return `false` if the build or any kernel failed.
+inline bool prepareCLKernels(cl_device_id deviceID, cl_context context, const std::string& sourceFile, std::initializer_list<std::pair<cl_kernel*, const char*>> kernels)
+{
+    cl_int ret = 0;
+    cl_program program = NULL;
+    
+    std::string clSrcString = readAllText(cinder::app::PlatformCocoa::get()->getResourcePath(sourceFile).string());
+    const char* str = clSrcString.c_str();
+    size_t sourceSize = clSrcString.length();
+    
+    program = clCreateProgramWithSource(context, 1, &str, &sourceSize, &ret);
+    logCLError(ret);
+    ret = clBuildProgram(program, 1, &deviceID, NULL, NULL, NULL);
+    logCLError(ret);
+    bool built = ret == CL_SUCCESS;
+    
+#if LOGENABLED
+    size_t len = 0;
+    clGetProgramBuildInfo(program, deviceID, CL_PROGRAM_BUILD_LOG, NULL, NULL, &len);
+    char* log = new char[len];
+    clGetProgramBuildInfo(program, deviceID, CL_PROGRAM_BUILD_LOG, len, log, NULL);
+    std::cerr << log << std::endl;
+    delete [] log;
+#endif
+    
+    for (auto& kernel : kernels)
+    {
+        *kernel.first = clCreateKernel(program, kernel.second, &ret);
+        logCLError(ret);
+        built &= ret == CL_SUCCESS;
+    }
+    
+    clReleaseProgram(program);
+    return built;
+}
+
+#endif /* OpenCLUtils_h */
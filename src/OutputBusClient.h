@@ -0,0 +1,217 @@
+//
+//  OutputBusClient.h
+//  GPUDSP
+//
+//  Layout of the shared memory output bus and a read-only client for other processes, needs nothing but POSIX and RingCursor.h.
+//
+
+#ifndef OutputBusClient_h
+#define OutputBusClient_h
+
+#include "RingCursor.h"
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+const uint32_t          outputBusVersion = 1;
+// samples start on a cache line of their own, away from the cursors the writer keeps moving
+const uint64_t          outputBusDataAlignment = 64;
+
+//! Start of the shared memory object, capacityFrames interleaved float frames follow at dataOffset.
+//! Frame n lives in slot n % capacityFrames. The writer never waits for readers, a reader that falls a whole capacity
+//! behind loses frames.
+struct OutputBusHeader
+{
+    char        magic[4];           // "GDSB", written last, so a reader never sees a half made header
+    uint32_t    version;
+    uint32_t    headerSize;
+    uint32_t    sampleRate;
+    uint32_t    channelsCount;
+    uint32_t    sampleBytes;        // 4, float samples
+    int32_t     writerPid;          // process writing the bus, another writer may only take the name over once it is gone
+    uint64_t    capacityFrames;
+    uint64_t    dataOffset;
+    std::atomic<uint64_t> writingFrame; // end of the frames being written, their slots are not to be trusted
+    std::atomic<uint64_t> writeFrame;   // frames written since the bus was created
+
+    bool isValid() const
+    {
+        return std::memcmp(magic, "GDSB", 4) == 0 && version <= outputBusVersion && headerSize >= sizeof(OutputBusHeader)
+            && sampleBytes == sizeof(float) && channelsCount > 0 && capacityFrames > 0 && dataOffset >= headerSize;
+    }
+
+    uint64_t getLength() const
+    {
+        return dataOffset + capacityFrames * channelsCount * sampleBytes;
+    }
+};
+
+//! Maps a bus read-only and follows its write cursor, each client with its own read cursor. Several clients can read
+//! the same bus, the writer does not know about any of them.
+class OutputBusClient
+{
+protected:
+    void*           _mapping;
+    size_t          _length;
+    const OutputBusHeader* _header;
+    const float*    _data;
+    uint64_t        _readFrame;
+    uint64_t        _droppedFrames;
+
+    void _catchUp(uint64_t writeFrame)
+    {
+        uint64_t readFrame = catchUpRingCursor(_readFrame, writeFrame, _header->capacityFrames);
+        _droppedFrames += readFrame - _readFrame;
+        _readFrame = readFrame;
+    }
+
+public:
+    OutputBusClient() : _mapping(NULL), _length(0), _header(NULL), _data(NULL), _readFrame(0), _droppedFrames(0) {}
+
+    ~OutputBusClient()
+    {
+        close();
+    }
+
+    OutputBusClient(const OutputBusClient&) = delete;
+    OutputBusClient& operator=(const OutputBusClient&) = delete;
+
+    //! Maps the bus SharedOutputBus created as \a name, "/GPUDSP" for the app. Reading starts at the newest frame.
+    //! \return `false` if there is no such bus or it is not one this client understands.
+    bool open(const std::string& name)
+    {
+        close();
+        int descriptor = shm_open(name.c_str(), O_RDONLY, 0);
+        if (descriptor < 0)
+            return false;
+
+        struct stat status;
+        if (fstat(descriptor, &status) == 0 && (size_t)status.st_size >= sizeof(OutputBusHeader))
+        {
+            _length = (size_t)status.st_size;
+            _mapping = mmap(NULL, _length, PROT_READ, MAP_SHARED, descriptor, 0);
+            if (_mapping == MAP_FAILED)
+                _mapping = NULL;
+        }
+        ::close(descriptor);
+        if (_mapping == NULL)
+            return false;
+
+        // the magic first, the fields the writer filled in before it after
+        _header = (const OutputBusHeader*)_mapping;
+        bool hasMagic = std::memcmp(_header->magic, "GDSB", 4) == 0;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (!hasMagic || !_header->isValid() || _header->getLength() > _length)
+        {
+            close();
+            return false;
+        }
+        _data = (const float*)((const uint8_t*)_mapping + _header->dataOffset);
+        _readFrame = _header->writeFrame.load(std::memory_order_acquire);
+        _droppedFrames = 0;
+        return true;
+    }
+
+    void close()
+    {
+        if (_mapping != NULL)
+            munmap(_mapping, _length);
+        _mapping = NULL;
+        _length = 0;
+        _header = NULL;
+        _data = NULL;
+    }
+
+    bool isOpen() const
+    {
+        return _mapping != NULL;
+    }
+
+    uint32_t getSampleRate() const
+    {
+        return _header->sampleRate;
+    }
+
+    uint32_t getChannelsCount() const
+    {
+        return _header->channelsCount;
+    }
+
+    //! Process writing the bus, the bus stops moving once it is gone.
+    int32_t getWriterPid() const
+    {
+        return _header->writerPid;
+    }
+
+    //! Frames skipped so far because the writer got a whole capacity ahead.
+    uint64_t getDroppedFrames() const
+    {
+        return _droppedFrames;
+    }
+
+    uint64_t getAvailableFrames()
+    {
+        uint64_t writeFrame = _header->writeFrame.load(std::memory_order_acquire);
+        _catchUp(writeFrame);
+        return writeFrame - _readFrame;
+    }
+
+    //! Points \a firstPart and \a secondPart straight into the bus at up to \a frames unread frames, secondPart is
+    //! NULL unless they wrap. \return frames pointed at. Once done with them, consume tells whether they held up.
+    size_t peek(size_t frames, const float*& firstPart, size_t& firstFrames, const float*& secondPart, size_t& secondFrames)
+    {
+        frames = (size_t)std::min<uint64_t>(frames, getAvailableFrames());
+        size_t channels = _header->channelsCount;
+        size_t slot = (size_t)(_readFrame % _header->capacityFrames);
+        firstFrames = std::min(frames, (size_t)_header->capacityFrames - slot);
+        secondFrames = frames - firstFrames;
+        firstPart = _data + slot * channels;
+        secondPart = secondFrames > 0 ? _data : NULL;
+        return frames;
+    }
+
+    //! Moves past \a frames peeked frames. \return `false` if the writer overwrote some of them while they were in use.
+    bool consume(size_t frames)
+    {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint64_t writingFrame = _header->writingFrame.load(std::memory_order_relaxed);
+        bool isIntact = writingFrame <= _readFrame + _header->capacityFrames;
+        _readFrame += frames;
+        return isIntact;
+    }
+
+    //! Copies up to \a frames unread interleaved frames into \a data. \return frames copied, frames the writer
+    //! overwrote during the copy are left out and counted as dropped.
+    size_t read(float* data, size_t frames)
+    {
+        const float* firstPart = NULL;
+        const float* secondPart = NULL;
+        size_t firstFrames = 0;
+        size_t secondFrames = 0;
+        frames = peek(frames, firstPart, firstFrames, secondPart, secondFrames);
+
+        size_t channels = _header->channelsCount;
+        std::memcpy(data, firstPart, firstFrames * channels * sizeof(float));
+        if (secondPart != NULL)
+            std::memcpy(data + firstFrames * channels, secondPart, secondFrames * channels * sizeof(float));
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint64_t writingFrame = _header->writingFrame.load(std::memory_order_relaxed);
+        uint64_t firstIntact = writingFrame > _header->capacityFrames ? writingFrame - _header->capacityFrames : 0;
+        size_t overwritten = (size_t)std::min<uint64_t>(frames, firstIntact > _readFrame ? firstIntact - _readFrame : 0);
+        if (overwritten > 0)
+            std::memmove(data, data + overwritten * channels, (frames - overwritten) * channels * sizeof(float));
+        _droppedFrames += overwritten;
+        _readFrame += frames;
+        return frames - overwritten;
+    }
+};
+
+#endif /* OutputBusClient_h */
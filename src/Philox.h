@@ -0,0 +1,97 @@
+//
+//  Philox.h
+//  GPUDSP
+//
+//  Counter-based Philox4x32-10 generator, bit-identical to philox4x32 in Cells.ncl.
+//
+
+#ifndef Philox_h
+#define Philox_h
+
+#include <cstdint>
+
+// random streams of a cell, the counter is (cell index, stream, epoch, 0), PhiloxGenerator counts in (low, high, 0, 1)
+enum PhiloxStream
+{
+    PhiloxStreamState = 0,      // initial cell states
+    PhiloxStreamFrequency = 1   // initial cell frequencies
+};
+
+//! Ten rounds of Philox4x32 on \a counter under the 64-bit key \a seed, the four outputs are independent 32-bit words.
+inline void philox4x32(const uint32_t counter[4], uint64_t seed, uint32_t output[4])
+{
+    uint32_t x0 = counter[0], x1 = counter[1], x2 = counter[2], x3 = counter[3];
+    uint32_t k0 = (uint32_t)seed, k1 = (uint32_t)(seed >> 32);
+    for (int round = 0; round < 10; ++round)
+    {
+        uint64_t product0 = (uint64_t)0xD2511F53u * x0;
+        uint64_t product1 = (uint64_t)0xCD9E8D57u * x2;
+        uint32_t y0 = (uint32_t)(product1 >> 32) ^ x1 ^ k0;
+        uint32_t y1 = (uint32_t)product1;
+        uint32_t y2 = (uint32_t)(product0 >> 32) ^ x3 ^ k1;
+        uint32_t y3 = (uint32_t)product0;
+        x0 = y0; x1 = y1; x2 = y2; x3 = y3;
+        k0 += 0x9E3779B9u;
+        k1 += 0xBB67AE85u;
+    }
+    output[0] = x0; output[1] = x1; output[2] = x2; output[3] = x3;
+}
+
+//! 24 high bits of \a bits in [0, 1), exact in float on both sides.
+inline float philoxUniform(uint32_t bits)
+{
+    return (float)(bits >> 8) * (1.0f / 16777216.0f);
+}
+
+//! Uniform [0, 1) value of cell \a index, the first word of its counter block.
+inline float philoxCellUniform(uint64_t seed, uint32_t index, uint32_t stream = PhiloxStreamState, uint32_t epoch = 0)
+{
+    uint32_t counter[4] = { index, stream, epoch, 0 };
+    uint32_t output[4];
+    philox4x32(counter, seed, output);
+    return philoxUniform(output[0]);
+}
+
+//! Sequential draws from one key, for host code that used rand(). Four words per counter block.
+class PhiloxGenerator
+{
+protected:
+    uint64_t    _seed;
+    uint64_t    _counter;
+    uint32_t    _block[4];
+    uint32_t    _used;
+
+public:
+    PhiloxGenerator(uint64_t seed = 0) : _seed(seed), _counter(0), _used(4) {}
+
+    uint64_t getSeed() const
+    {
+        return _seed;
+    }
+
+    uint32_t next()
+    {
+        if (_used == 4)
+        {
+            uint32_t counter[4] = { (uint32_t)_counter, (uint32_t)(_counter >> 32), 0, 1 };
+            philox4x32(counter, _seed, _block);
+            ++_counter;
+            _used = 0;
+        }
+        return _block[_used++];
+    }
+
+    //! Uniform in [min, max).
+    float nextUniform(float min = 0.0f, float max = 1.0f)
+    {
+        return min + (max - min) * philoxUniform(next());
+    }
+
+    //! Uniform integer in [0, count).
+    uint32_t nextIndex(uint32_t count)
+    {
+        return (uint32_t)(((uint64_t)next() * count) >> 32);
+    }
+};
+
+#endif /* Philox_h */
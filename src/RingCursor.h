@@ -0,0 +1,23 @@
+//
+//  RingCursor.h
+//  GPUDSP
+//
+//  Catch up rule shared by the readers of rings that never wait for them, see BroadcastRingBuffer.h and OutputBusClient.h.
+//
+
+#ifndef RingCursor_h
+#define RingCursor_h
+
+#include <cstdint>
+
+//! Where a reader at \a readIndex goes once the writer is at \a writeIndex, both counted since the start of a ring of
+//! \a capacity elements. A reader lapped by the writer skips to the newest half, which the writer will not reach for a
+//! while, on a \a granule boundary so interleaved frames stay whole. \return \a readIndex if it was not lapped.
+inline uint64_t catchUpRingCursor(uint64_t readIndex, uint64_t writeIndex, uint64_t capacity, uint64_t granule = 1)
+{
+    if (writeIndex - readIndex <= capacity)
+        return readIndex;
+    return writeIndex - capacity / 2 / granule * granule;
+}
+
+#endif /* RingCursor_h */
@@ -0,0 +1,212 @@
+//
+//  RuleExplorer.h
+//  GPUDSP
+//
+//  Offline sweep over continuous rule sets, scored by cheap metrics and ranked into a catalogue.
+//
+
+#ifndef RuleExplorer_h
+#define RuleExplorer_h
+
+#include "CellsCPU.h"
+#include "Convolution.h"
+#include "CycleDetector.h"
+#include "Philox.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <string>
+#include <vector>
+
+struct RuleCandidate
+{
+    float       rules[5];   // birth center, birth radius, keep center, keep radius, speed
+    uint64_t    seed;       // grid seed, as DSPOpenCL::reseed takes it
+
+    float       activity;   // mean state change per cell and generation
+    float       density;    // mean state
+    float       rms;        // deviation of the output around its mean
+    float       centroid;   // spectral centroid of the output in Hz, one generation per sample
+    size_t      period;     // generations of the cycle the grid settled into, 0 if none was found
+    float       score;
+};
+
+struct RuleExplorerSettings
+{
+    size_t      width = 32;
+    size_t      height = 32;
+    size_t      warmup = 256;           // generations skipped before measuring
+    size_t      generations = 1024;     // generations measured, rounded up to a power of two for the spectrum
+    float       sampleRate = 44100.0f;
+    float       centerMax = 8.0f;       // centers are drawn over the reachable neighbour sums
+    float       radiusMax = 2.0f;
+    uint32_t    speedMax = 6;
+};
+
+//! Candidates are independent, so they are spread over the pool one grid per task.
+class RuleExplorer
+{
+protected:
+    RuleExplorerSettings    _settings;
+    ThreadPool*             _pool;
+
+    // dead, saturated and frozen grids score 0, short cycles are penalized, the rest trades loudness against motion
+    static float _score(const RuleCandidate& candidate)
+    {
+        if (candidate.density < 0.02f || candidate.density > 0.98f || candidate.activity < 1e-4f)
+            return 0.0f;
+        float periodFactor = candidate.period == 0 ? 1.0f : std::min(1.0f, (float)candidate.period / 256.0f);
+        return candidate.rms * sqrtf(candidate.activity) * periodFactor;
+    }
+
+    // the output as the first of two columns, whose transform along x is its plain spectrum
+    float _centroid(const std::vector<float>& output) const
+    {
+        size_t count = output.size();
+        std::vector<std::complex<float>> data(count * 2);
+        for (size_t i = 0; i < count; ++i)
+            data[i * 2] = output[i];
+        FFT2D(count, 2).transform(data.data(), false);
+
+        double weighted = 0.0;
+        double total = 0.0;
+        for (size_t k = 1; k <= count / 2; ++k)
+        {
+            double magnitude = std::abs(data[k * 2]);
+            weighted += magnitude * (double)k;
+            total += magnitude;
+        }
+        return total > 0.0 ? (float)(weighted / total * _settings.sampleRate / (double)count) : 0.0f;
+    }
+
+public:
+    RuleExplorer(const RuleExplorerSettings& settings = RuleExplorerSettings(), ThreadPool* pool = nullptr) : _settings(settings), _pool(pool)
+    {
+        size_t generations = 2;
+        while (generations < _settings.generations)
+            generations *= 2;
+        _settings.generations = generations;
+    }
+
+    const RuleExplorerSettings& getSettings() const
+    {
+        return _settings;
+    }
+
+    //! \a count rule sets and grid seeds drawn uniformly from the settings ranges, reproducible from \a seed.
+    std::vector<RuleCandidate> sampleCandidates(size_t count, uint64_t seed) const
+    {
+        PhiloxGenerator random(seed);
+        std::vector<RuleCandidate> candidates(count);
+        for (RuleCandidate& candidate : candidates)
+        {
+            candidate = RuleCandidate();
+            candidate.rules[0] = random.nextUniform(0.0f, _settings.centerMax);
+            candidate.rules[1] = random.nextUniform(0.0f, _settings.radiusMax);
+            candidate.rules[2] = random.nextUniform(0.0f, _settings.centerMax);
+            candidate.rules[3] = random.nextUniform(0.0f, _settings.radiusMax);
+            candidate.rules[4] = (float)random.nextIndex(_settings.speedMax + 1);
+            candidate.seed = ((uint64_t)random.next() << 32) | random.next();
+        }
+        return candidates;
+    }
+
+    //! Runs one candidate and fills in its metrics and score. Safe to call from several threads.
+    void evaluate(RuleCandidate& candidate) const
+    {
+        size_t cellsCount = _settings.width * _settings.height;
+        std::vector<float> state(cellsCount);
+        std::vector<float> previous(cellsCount);
+        for (size_t i = 0; i < cellsCount; ++i)
+            state[i] = philoxCellUniform(candidate.seed, (uint32_t)i);
+
+        CellsCPU cells(_settings.width, _settings.height);
+        cells.setRules(candidate.rules);
+        cells.load(state.data());
+        for (size_t g = 0; g < _settings.warmup; ++g)
+            cells.step();
+
+        // one state per measured generation is all the cycle detector needs to keep
+        CycleDetector cycles(cellsCount * sizeof(float), _settings.generations * cellsCount * sizeof(float), _settings.generations);
+        std::vector<float> output(_settings.generations);
+        double change = 0.0;
+        double mean = 0.0;
+        cells.copyState(previous.data());
+        for (size_t g = 0; g < _settings.generations; ++g)
+        {
+            float sum = cells.getSum();
+            output[g] = sum * 2.0f / (float)cellsCount - 1.0f;
+            mean += sum / (float)cellsCount;
+            if (!cycles.isLocked())
+                cycles.push(previous.data(), output[g]);
+
+            cells.step();
+            cells.copyState(state.data());
+            for (size_t i = 0; i < cellsCount; ++i)
+                change += fabsf(state[i] - previous[i]);
+            std::swap(state, previous);
+        }
+
+        candidate.density = (float)(mean / (double)_settings.generations);
+        candidate.activity = (float)(change / (double)(_settings.generations * cellsCount));
+        candidate.period = cycles.isLocked() ? cycles.getPeriod() : 0;
+
+        float outputMean = candidate.density * 2.0f - 1.0f;
+        double deviation = 0.0;
+        for (float& sample : output)
+        {
+            sample -= outputMean;
+            deviation += sample * sample;
+        }
+        candidate.rms = (float)sqrt(deviation / (double)_settings.generations);
+        candidate.centroid = _centroid(output);
+        candidate.score = _score(candidate);
+    }
+
+    //! Evaluates \a candidates across the pool and sorts them best first.
+    void rank(std::vector<RuleCandidate>& candidates) const
+    {
+        auto job = [this, &candidates](size_t i) { evaluate(candidates[i]); };
+        if (_pool)
+            _pool->parallelFor(candidates.size(), job);
+        else
+            for (size_t i = 0; i < candidates.size(); ++i)
+                job(i);
+
+        std::stable_sort(candidates.begin(), candidates.end(), [](const RuleCandidate& a, const RuleCandidate& b) { return a.score > b.score; });
+    }
+
+    std::vector<RuleCandidate> explore(size_t count, uint64_t seed)
+    {
+        std::vector<RuleCandidate> candidates = sampleCandidates(count, seed);
+        rank(candidates);
+        return candidates;
+    }
+
+    //! One CSV row per candidate in the given order, rules and seed first so a row can be fed back to the engine.
+    static bool writeCatalogue(const std::vector<RuleCandidate>& candidates, const std::string& path)
+    {
+        std::ofstream file(path);
+        if (!file)
+            return false;
+
+        // enough digits that a rule read back is the same float
+        file << std::setprecision(std::numeric_limits<float>::max_digits10);
+        file << "rank,birthCenter,birthRadius,keepCenter,keepRadius,speed,seed,score,activity,density,rms,centroid,period\n";
+        for (size_t i = 0; i < candidates.size(); ++i)
+        {
+            const RuleCandidate& candidate = candidates[i];
+            file << i + 1;
+            for (float rule : candidate.rules)
+                file << "," << rule;
+            file << "," << candidate.seed << "," << candidate.score << "," << candidate.activity << "," << candidate.density
+                 << "," << candidate.rms << "," << candidate.centroid << "," << candidate.period << "\n";
+        }
+        return (bool)file;
+    }
+};
+
+#endif /* RuleExplorer_h */
@@ -0,0 +1,139 @@
+//
+//  SharedOutputBus.h
+//  GPUDSP
+//
+//  Publishes the output frames in POSIX shared memory for other processes on the host, see OutputBusClient.h.
+//
+
+#ifndef SharedOutputBus_h
+#define SharedOutputBus_h
+
+#include "OutputBusClient.h"
+#include <cerrno>
+#include <new>
+#include <signal.h>
+
+//! Writer side of the bus, one per name. Written from the audio thread, it never blocks and never waits for readers.
+class SharedOutputBus
+{
+protected:
+    std::string     _name;
+    void*           _mapping;
+    size_t          _length;
+    OutputBusHeader* _header;
+    float*          _data;
+
+    // a bus left by a writer that is gone, one still being set up or with a live writer is left alone
+    static bool _isStale(const std::string& name)
+    {
+        OutputBusClient client;
+        if (!client.open(name))
+            return false;
+        pid_t writer = (pid_t)client.getWriterPid();
+        return writer > 0 && kill(writer, 0) != 0 && errno == ESRCH;
+    }
+
+public:
+    SharedOutputBus() : _mapping(NULL), _length(0), _header(NULL), _data(NULL) {}
+
+    ~SharedOutputBus()
+    {
+        close();
+    }
+
+    SharedOutputBus(const SharedOutputBus&) = delete;
+    SharedOutputBus& operator=(const SharedOutputBus&) = delete;
+
+    //! Creates the bus \a name, a leading slash and at most 31 characters on macOS, replacing one whose writer process is
+    //! gone. It holds \a capacityFrames frames of \a channelsCount interleaved channels.
+    //! \return `false` if another process is writing a bus of that name.
+    bool create(const std::string& name, uint32_t sampleRate, uint32_t channelsCount, uint64_t capacityFrames)
+    {
+        close();
+        int descriptor = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+        if (descriptor < 0 && errno == EEXIST && _isStale(name))
+        {
+            shm_unlink(name.c_str());
+            descriptor = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+        }
+        if (descriptor < 0)
+            return false;
+
+        uint64_t dataOffset = (sizeof(OutputBusHeader) + outputBusDataAlignment - 1) / outputBusDataAlignment * outputBusDataAlignment;
+        _length = (size_t)(dataOffset + capacityFrames * channelsCount * sizeof(float));
+        if (ftruncate(descriptor, (off_t)_length) == 0)
+        {
+            _mapping = mmap(NULL, _length, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+            if (_mapping == MAP_FAILED)
+                _mapping = NULL;
+        }
+        ::close(descriptor);
+        if (_mapping == NULL)
+        {
+            shm_unlink(name.c_str());
+            _length = 0;
+            return false;
+        }
+        _name = name;
+
+        _header = new (_mapping) OutputBusHeader();
+        _header->version = outputBusVersion;
+        _header->headerSize = sizeof(OutputBusHeader);
+        _header->sampleRate = sampleRate;
+        _header->channelsCount = channelsCount;
+        _header->sampleBytes = sizeof(float);
+        _header->writerPid = (int32_t)getpid();
+        _header->capacityFrames = capacityFrames;
+        _header->dataOffset = dataOffset;
+        _header->writingFrame = 0;
+        _header->writeFrame = 0;
+        _data = (float*)((uint8_t*)_mapping + dataOffset);
+        std::atomic_thread_fence(std::memory_order_release);
+        std::memcpy(_header->magic, "GDSB", 4);
+        return true;
+    }
+
+    //! Unmaps and removes the bus, clients that have it mapped keep their mapping.
+    void close()
+    {
+        if (_mapping == NULL)
+            return;
+        munmap(_mapping, _length);
+        shm_unlink(_name.c_str());
+        _mapping = NULL;
+        _length = 0;
+        _header = NULL;
+        _data = NULL;
+    }
+
+    bool isOpen() const
+    {
+        return _mapping != NULL;
+    }
+
+    //! Appends \a frames interleaved frames, only the newest capacity of them if there are more. Only safe on one thread.
+    void write(const float* data, size_t frames)
+    {
+        uint64_t capacity = _header->capacityFrames;
+        size_t channels = _header->channelsCount;
+        if (frames > capacity)
+        {
+            data += (frames - capacity) * channels;
+            frames = (size_t)capacity;
+        }
+
+        // clients check writingFrame after copying, so it has to move before the slots it covers change
+        uint64_t writeFrame = _header->writeFrame.load(std::memory_order_relaxed);
+        _header->writingFrame.store(writeFrame + frames, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        size_t slot = (size_t)(writeFrame % capacity);
+        size_t firstFrames = std::min(frames, (size_t)capacity - slot);
+        std::memcpy(_data + slot * channels, data, firstFrames * channels * sizeof(float));
+        std::memcpy(_data, data + firstFrames * channels, (frames - firstFrames) * channels * sizeof(float));
+
+        _header->writeFrame.store(writeFrame + frames, std::memory_order_release);
+    }
+};
+
+#endif /* SharedOutputBus_h */
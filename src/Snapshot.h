@@ -0,0 +1,244 @@
+//
+//  Snapshot.h
+//  GPUDSP
+//
+//  Versioned binary grid snapshots, written whole and read back through mmap.
+//
+
+#ifndef Snapshot_h
+#define Snapshot_h
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+const uint32_t          snapshotVersion = 1;
+// state planes start on this boundary so they can be handed to the device straight from the mapping
+const uint64_t          snapshotDataAlignment = 64;
+
+//! Fixed little-endian header, the state planes follow at dataOffset.
+struct SnapshotHeader
+{
+    char        magic[4];           // "GDSS"
+    uint32_t    version;
+    uint32_t    headerSize;         // sizeof(SnapshotHeader) of the writer, readers skip what they do not know
+    uint32_t    width;
+    uint32_t    height;
+    uint32_t    cellsMode;          // CellsMode of the engine that saved it
+    uint32_t    componentBytes;     // precision, 4 for float
+    uint32_t    componentsCount;    // values per cell and plane, 4 for the float4 cells
+    uint32_t    planesCount;
+    uint32_t    boundaryMode;
+    float       boundaryValue;
+    float       rules[5];
+    uint64_t    generation;         // generations computed when it was saved
+    uint64_t    seed;               // Philox key the grid was seeded from
+    uint64_t    dataOffset;
+
+    SnapshotHeader()
+    {
+        std::memset(this, 0, sizeof(SnapshotHeader));
+        std::memcpy(magic, "GDSS", 4);
+        version = snapshotVersion;
+        headerSize = sizeof(SnapshotHeader);
+        planesCount = 1;
+        dataOffset = (sizeof(SnapshotHeader) + snapshotDataAlignment - 1) / snapshotDataAlignment * snapshotDataAlignment;
+    }
+
+    uint64_t getPlaneLength() const
+    {
+        return (uint64_t)width * height * componentsCount * componentBytes;
+    }
+
+    bool isValid() const
+    {
+        return std::memcmp(magic, "GDSS", 4) == 0 && version <= snapshotVersion && headerSize >= offsetof(SnapshotHeader, dataOffset) + sizeof(uint64_t)
+            && dataOffset >= headerSize && componentBytes > 0 && componentsCount > 0 && planesCount > 0;
+    }
+};
+
+//! Writes the header and \a planes (header.planesCount of header.getPlaneLength() bytes each) next to \a path and renames
+//! it into place, so a reader never maps a half written file.
+inline bool writeSnapshot(const std::string& path, const SnapshotHeader& header, const void* planes)
+{
+    std::string temporaryPath = path + ".tmp";
+    FILE* file = fopen(temporaryPath.c_str(), "wb");
+    if (file == NULL)
+        return false;
+
+    static const char padding[snapshotDataAlignment] = { 0 };
+    bool written = fwrite(&header, sizeof(SnapshotHeader), 1, file) == 1
+        && fwrite(padding, 1, header.dataOffset - sizeof(SnapshotHeader), file) == header.dataOffset - sizeof(SnapshotHeader)
+        && fwrite(planes, header.getPlaneLength(), header.planesCount, file) == header.planesCount;
+    written = fclose(file) == 0 && written;
+    if (!written || rename(temporaryPath.c_str(), path.c_str()) != 0)
+    {
+        remove(temporaryPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+//! Writes snapshots one at a time on a thread of its own, started with the first one. The destructor writes out what
+//! is still queued and joins it, so no write outlives the owner.
+class SnapshotWriter
+{
+protected:
+    struct Job
+    {
+        std::string     path;
+        SnapshotHeader  header;
+        std::shared_ptr<const void> planes;
+    };
+
+    std::thread     _worker;
+    std::mutex      _mutex;
+    std::condition_variable _wake;
+    std::deque<Job> _jobs;
+    bool            _isStopping;
+
+    void _work()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        while (true)
+        {
+            _wake.wait(lock, [this]() { return _isStopping || !_jobs.empty(); });
+            if (_jobs.empty())
+                return;
+
+            Job job = std::move(_jobs.front());
+            _jobs.pop_front();
+            lock.unlock();
+            bool written = writeSnapshot(job.path, job.header, job.planes.get());
+#if LOGENABLED
+            std::cout << "[Snapshot]: " << (written ? "saved " : "failed to save ") << job.path << std::endl;
+#endif
+            (void)written;
+            lock.lock();
+        }
+    }
+
+public:
+    SnapshotWriter() : _isStopping(false) {}
+
+    ~SnapshotWriter()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _isStopping = true;
+        }
+        _wake.notify_one();
+        if (_worker.joinable())
+            _worker.join();
+    }
+
+    SnapshotWriter(const SnapshotWriter&) = delete;
+    SnapshotWriter& operator=(const SnapshotWriter&) = delete;
+
+    //! Queues \a planes for writeSnapshot to \a path, they are kept alive until written.
+    void write(const std::string& path, const SnapshotHeader& header, std::shared_ptr<const void> planes)
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _jobs.push_back(Job { path, header, planes });
+            if (!_worker.joinable())
+                _worker = std::thread(&SnapshotWriter::_work, this);
+        }
+        _wake.notify_one();
+    }
+};
+
+//! Read-only mapping of a snapshot file. Planes point into the mapping, nothing is copied until someone reads them.
+class SnapshotFile
+{
+protected:
+    void*           _mapping;
+    size_t          _length;
+    SnapshotHeader  _header;
+
+public:
+    SnapshotFile() : _mapping(NULL), _length(0) {}
+
+    ~SnapshotFile()
+    {
+        close();
+    }
+
+    SnapshotFile(const SnapshotFile&) = delete;
+    SnapshotFile& operator=(const SnapshotFile&) = delete;
+
+    //! \return `false` if the file cannot be mapped, is not a snapshot, or is shorter than its header says.
+    bool open(const std::string& path)
+    {
+        close();
+        int descriptor = ::open(path.c_str(), O_RDONLY);
+        if (descriptor < 0)
+            return false;
+
+        struct stat status;
+        if (fstat(descriptor, &status) == 0 && (size_t)status.st_size >= sizeof(SnapshotHeader))
+        {
+            _length = (size_t)status.st_size;
+            _mapping = mmap(NULL, _length, PROT_READ, MAP_PRIVATE, descriptor, 0);
+            if (_mapping == MAP_FAILED)
+                _mapping = NULL;
+        }
+        ::close(descriptor);
+        if (_mapping == NULL)
+            return false;
+
+        // older headers are shorter, the fields they lack stay zero
+        uint32_t headerSize = ((const SnapshotHeader*)_mapping)->headerSize;
+        std::memset((void*)&_header, 0, sizeof(SnapshotHeader));
+        if (headerSize <= _length)
+            std::memcpy(&_header, _mapping, std::min<size_t>(sizeof(SnapshotHeader), headerSize));
+        // every bound is checked by division, the sizes come from the file and may be anything
+        uint64_t cellBytes = (uint64_t)_header.componentsCount * _header.componentBytes;
+        if (headerSize > _length || !_header.isValid() || _header.dataOffset > _length
+            || (uint64_t)_header.width * _header.height > (_length - _header.dataOffset) / cellBytes / _header.planesCount)
+        {
+            close();
+            return false;
+        }
+        madvise(_mapping, _length, MADV_SEQUENTIAL);
+        return true;
+    }
+
+    void close()
+    {
+        if (_mapping != NULL)
+            munmap(_mapping, _length);
+        _mapping = NULL;
+        _length = 0;
+    }
+
+    bool isOpen() const
+    {
+        return _mapping != NULL;
+    }
+
+    const SnapshotHeader& getHeader() const
+    {
+        return _header;
+    }
+
+    const void* getPlane(uint32_t plane) const
+    {
+        return (const uint8_t*)_mapping + _header.dataOffset + _header.getPlaneLength() * plane;
+    }
+};
+
+#endif /* Snapshot_h */
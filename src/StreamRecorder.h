@@ -0,0 +1,272 @@
+//
+//  StreamRecorder.h
+//  GPUDSP
+//
+//  Records the output to float WAV or raw files on a background thread, the audio thread only copies into a queue.
+//
+
+#ifndef StreamRecorder_h
+#define StreamRecorder_h
+
+#include "BroadcastRingBuffer.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+
+struct StreamRecorderSettings
+{
+    bool            wav = true;                     // float WAV, raw interleaved float32 otherwise
+    double          queueDuration = 2.0;            // seconds the writer may fall behind before frames are dropped
+    size_t          chunkBytes = 1 << 20;           // bytes per write, rounded to whole frames in 4 KiB multiples
+    uint64_t        maxFileBytes = 1ull << 31;      // a new file starts past this, WAV sizes are 32 bit
+    double          headerInterval = 5.0;           // seconds between WAV header updates, a crash loses at most this
+};
+
+//! Writes <path>-0001.wav, <path>-0002.wav, ... Data starts at 4 KiB behind a JUNK chunk and goes out in whole chunks
+//! from an aligned buffer, so every write but the last one of a file is large and aligned.
+class StreamRecorder
+{
+protected:
+    static const size_t _dataOffset = 4096;
+
+    StreamRecorderSettings _settings;
+    uint32_t        _sampleRate;
+    uint32_t        _channels;
+    BroadcastRingBufferT<float> _queue;
+    std::atomic<bool> _isRecording;
+    std::atomic<uint64_t> _droppedFrames;
+    std::thread     _writer;
+
+    // writer thread
+    std::string     _path;
+    float*          _chunk;
+    size_t          _chunkLength;
+    size_t          _chunkFilled;
+    int             _file;
+    int             _fileIndex;
+    uint64_t        _fileBytes;
+
+    static void _put16(uint8_t*& target, uint16_t value)
+    {
+        target[0] = (uint8_t)value;
+        target[1] = (uint8_t)(value >> 8);
+        target += 2;
+    }
+
+    static void _put32(uint8_t*& target, uint32_t value)
+    {
+        for (int i = 0; i < 4; ++i)
+            *target++ = (uint8_t)(value >> (8 * i));
+    }
+
+    static void _putTag(uint8_t*& target, const char* tag)
+    {
+        std::memcpy(target, tag, 4);
+        target += 4;
+    }
+
+    // RIFF, fmt with WAVE_FORMAT_IEEE_FLOAT, fact, a JUNK chunk up to _dataOffset, then the data chunk header
+    void _writeHeader()
+    {
+        uint8_t header[_dataOffset] = { 0 };
+        uint8_t* target = header;
+        uint32_t frameBytes = _channels * sizeof(float);
+        _putTag(target, "RIFF");
+        _put32(target, (uint32_t)(_dataOffset - 8 + _fileBytes));
+        _putTag(target, "WAVE");
+        _putTag(target, "fmt ");
+        _put32(target, 18);
+        _put16(target, 3);
+        _put16(target, (uint16_t)_channels);
+        _put32(target, _sampleRate);
+        _put32(target, _sampleRate * frameBytes);
+        _put16(target, (uint16_t)frameBytes);
+        _put16(target, 32);
+        _put16(target, 0);
+        _putTag(target, "fact");
+        _put32(target, 4);
+        _put32(target, (uint32_t)(_fileBytes / frameBytes));
+        _putTag(target, "JUNK");
+        _put32(target, (uint32_t)(header + _dataOffset - 8 - (target + 4)));
+        target = header + _dataOffset - 8;
+        _putTag(target, "data");
+        _put32(target, (uint32_t)_fileBytes);
+        pwrite(_file, header, _dataOffset, 0);
+    }
+
+    bool _openFile()
+    {
+        char suffix[32];
+        snprintf(suffix, sizeof(suffix), "-%04d.%s", ++_fileIndex, _settings.wav ? "wav" : "raw");
+        _file = ::open((_path + suffix).c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        _fileBytes = 0;
+        if (_file < 0)
+        {
+            std::cerr << "[Recorder]: cannot open " << _path << suffix << std::endl;
+            return false;
+        }
+#ifdef F_NOCACHE
+        // hours of audio would only push everything else out of the page cache
+        fcntl(_file, F_NOCACHE, 1);
+#endif
+        if (_settings.wav)
+            _writeHeader();
+        return true;
+    }
+
+    void _closeFile()
+    {
+        if (_file < 0)
+            return;
+        if (_settings.wav)
+            _writeHeader();
+        ::close(_file);
+        _file = -1;
+    }
+
+    void _flushChunk()
+    {
+        size_t bytes = _chunkFilled * sizeof(float);
+        if (bytes == 0 || _file < 0)
+            return;
+        if (_fileBytes > 0 && _fileBytes + bytes > _settings.maxFileBytes)
+        {
+            _closeFile();
+            _openFile();
+            if (_file < 0)
+                return;
+        }
+        off_t offset = (off_t)((_settings.wav ? _dataOffset : 0) + _fileBytes);
+        if (pwrite(_file, _chunk, bytes, offset) == (ssize_t)bytes)
+            _fileBytes += bytes;
+        _chunkFilled = 0;
+    }
+
+    void _work()
+    {
+        const float* firstPart = nullptr;
+        const float* secondPart = nullptr;
+        size_t firstLength = 0;
+        size_t secondLength = 0;
+        auto headerTime = std::chrono::steady_clock::now();
+        if (!_openFile())
+            _isRecording = false;
+        while (_file >= 0)
+        {
+            bool isStopping = !_isRecording;
+            size_t count = _queue.peek(0, _chunkLength - _chunkFilled, firstPart, firstLength, secondPart, secondLength);
+            std::memcpy(_chunk + _chunkFilled, firstPart, firstLength * sizeof(float));
+            if (secondPart != nullptr)
+                std::memcpy(_chunk + _chunkFilled + firstLength, secondPart, secondLength * sizeof(float));
+            _queue.consume(0, count);
+            _chunkFilled += count;
+
+            if (_chunkFilled == _chunkLength)
+                _flushChunk();
+            if (_settings.wav && std::chrono::steady_clock::now() - headerTime > std::chrono::duration<double>(_settings.headerInterval))
+            {
+                _writeHeader();
+                headerTime = std::chrono::steady_clock::now();
+            }
+            if (isStopping && _queue.getAvailableRead() == 0)
+                break;
+            if (count == 0)
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        _flushChunk();
+        _closeFile();
+    }
+
+public:
+    //! Sizes the queue and the chunk for \a sampleRate and \a channels, nothing is allocated once recording runs.
+    StreamRecorder(uint32_t sampleRate, uint32_t channels, const StreamRecorderSettings& settings = StreamRecorderSettings()) :
+    _settings(settings),
+    _sampleRate(sampleRate),
+    _channels(std::max<uint32_t>(1, channels)),
+    _queue((size_t)(settings.queueDuration * sampleRate) * std::max<uint32_t>(1, channels), std::max<uint32_t>(1, channels))
+    {
+        _isRecording = false;
+        _droppedFrames = 0;
+        _file = -1;
+        _fileIndex = 0;
+        _fileBytes = 0;
+        _chunkFilled = 0;
+
+        // 1024 frames of float are a multiple of 4 KiB for any channel count
+        size_t chunkFrames = std::max<size_t>(1, _settings.chunkBytes / (_channels * sizeof(float) * 1024)) * 1024;
+        _chunkLength = chunkFrames * _channels;
+        void* chunk = NULL;
+        if (posix_memalign(&chunk, 4096, _chunkLength * sizeof(float)) != 0)
+            chunk = NULL;
+        _chunk = (float*)chunk;
+    }
+
+    ~StreamRecorder()
+    {
+        stop();
+        free(_chunk);
+    }
+
+    StreamRecorder(const StreamRecorder&) = delete;
+    StreamRecorder& operator=(const StreamRecorder&) = delete;
+
+    //! Starts writing files named after \a path, \return false if already recording.
+    bool start(const std::string& path)
+    {
+        if (_isRecording || _chunk == NULL)
+            return false;
+        if (_writer.joinable())
+            _writer.join();
+        // what push queued after the last recording stopped is not part of this one, no writer reads the queue now
+        const float* firstPart = nullptr;
+        const float* secondPart = nullptr;
+        size_t firstLength = 0;
+        size_t secondLength = 0;
+        _queue.consume(0, _queue.peek(0, _queue.getSize(), firstPart, firstLength, secondPart, secondLength));
+
+        _path = path;
+        _fileIndex = 0;
+        _chunkFilled = 0;
+        _droppedFrames = 0;
+        _isRecording = true;
+        _writer = std::thread(&StreamRecorder::_work, this);
+        return true;
+    }
+
+    //! Writes out what is queued and closes the file.
+    void stop()
+    {
+        _isRecording = false;
+        if (_writer.joinable())
+            _writer.join();
+    }
+
+    bool isRecording()
+    {
+        return _isRecording;
+    }
+
+    //! Queues \a frames interleaved frames, or drops all of them if the writer is too far behind. For the audio thread,
+    //! a copy into memory allocated up front and nothing else.
+    void push(const float* data, size_t frames)
+    {
+        if (!_isRecording)
+            return;
+        if (!_queue.write(data, frames * _channels))
+            _droppedFrames.fetch_add(frames, std::memory_order_relaxed);
+    }
+
+    //! Frames push could not queue during this recording.
+    uint64_t getDroppedFrames()
+    {
+        return _droppedFrames;
+    }
+};
+
+#endif /* StreamRecorder_h */
@@ -0,0 +1,163 @@
+//
+//  ThreadPool.h
+//  GPUDSP
+//
+//  Fork-join pool with per-worker task queues and work stealing.
+//
+
+#ifndef ThreadPool_h
+#define ThreadPool_h
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool
+{
+protected:
+    struct Queue
+    {
+        std::mutex          mutex;
+        std::deque<size_t>  tasks;
+    };
+
+    std::vector<std::thread>                _threads;
+    std::vector<std::unique_ptr<Queue>>     _queues;
+    std::function<void(size_t)>             _job;
+    std::atomic<size_t>                     _pending;
+
+    std::mutex                              _mutex;
+    std::condition_variable                 _wake;
+    std::condition_variable                 _done;
+    uint64_t                                _jobId;
+    bool                                    _isStopping;
+
+    // own queue from the back, the end this worker filled last
+    bool _pop(size_t worker, size_t& task)
+    {
+        Queue& queue = *_queues[worker];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty())
+            return false;
+        task = queue.tasks.back();
+        queue.tasks.pop_back();
+        return true;
+    }
+
+    // other queues from the front, away from their owners
+    bool _steal(size_t worker, size_t& task)
+    {
+        for (size_t i = 1; i < _queues.size(); ++i)
+        {
+            Queue& queue = *_queues[(worker + i) % _queues.size()];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (queue.tasks.empty())
+                continue;
+            task = queue.tasks.front();
+            queue.tasks.pop_front();
+            return true;
+        }
+        return false;
+    }
+
+    void _work(size_t worker)
+    {
+        size_t task;
+        while (_pop(worker, task) || _steal(worker, task))
+        {
+            _job(task);
+            if (--_pending == 0)
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _done.notify_all();
+            }
+        }
+    }
+
+    void _loop(size_t worker)
+    {
+        uint64_t seenJobId = 0;
+        for (;;)
+        {
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _wake.wait(lock, [&] { return _isStopping || _jobId != seenJobId; });
+                if (_isStopping)
+                    return;
+                seenJobId = _jobId;
+            }
+            _work(worker);
+        }
+    }
+
+public:
+    //! The calling thread works too, so \a threadsCount - 1 threads are spawned. 0 uses every core.
+    ThreadPool(size_t threadsCount = 0) : _pending(0), _jobId(0), _isStopping(false)
+    {
+        if (threadsCount == 0)
+            threadsCount = std::max(1u, std::thread::hardware_concurrency());
+
+        for (size_t i = 0; i < threadsCount; ++i)
+            _queues.emplace_back(new Queue());
+        for (size_t i = 1; i < threadsCount; ++i)
+            _threads.emplace_back(&ThreadPool::_loop, this, i);
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _isStopping = true;
+        }
+        _wake.notify_all();
+        for (std::thread& thread : _threads)
+            thread.join();
+    }
+
+    size_t getThreadsCount() const
+    {
+        return _queues.size();
+    }
+
+    //! Runs job(0) .. job(count - 1) across the pool and returns once all of them finished. Not reentrant.
+    void parallelFor(size_t count, const std::function<void(size_t)>& job)
+    {
+        if (count == 0)
+            return;
+
+        if (_threads.empty())
+        {
+            for (size_t i = 0; i < count; ++i)
+                job(i);
+            return;
+        }
+
+        // contiguous chunks keep neighbouring tasks on one worker until someone steals them
+        _job = job;
+        _pending = count;
+        size_t workers = _queues.size();
+        for (size_t worker = 0; worker < workers; ++worker)
+        {
+            std::lock_guard<std::mutex> lock(_queues[worker]->mutex);
+            for (size_t i = worker * count / workers; i < (worker + 1) * count / workers; ++i)
+                _queues[worker]->tasks.push_front(i);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            ++_jobId;
+        }
+        _wake.notify_all();
+
+        _work(0);
+        std::unique_lock<std::mutex> lock(_mutex);
+        _done.wait(lock, [&] { return _pending == 0; });
+    }
+};
+
+#endif /* ThreadPool_h */
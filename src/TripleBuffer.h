@@ -0,0 +1,79 @@
+//
+//  TripleBuffer.h
+//  GPUDSP
+//
+//  Lock-free handoff of the latest value from one writer thread to one reader thread.
+//
+
+#ifndef TripleBuffer_h
+#define TripleBuffer_h
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//! Three arrays of \a count elements: the writer fills one, the reader holds one, the third is the last one published.
+//! Publishing and picking up swap an array with the middle one, so neither side waits and the reader always gets
+//! the newest array, skipping the ones published in between.
+template <typename T>
+class TripleBufferT
+{
+protected:
+    static const uint8_t _fresh = 4;  // set on the middle index when the writer published it after the reader's last pick up
+
+    std::vector<T>          _buffers[3];
+    size_t                  _writeIndex;
+    size_t                  _readIndex;
+    std::atomic<uint8_t>    _middle;
+
+public:
+    TripleBufferT() : _writeIndex(0), _readIndex(1), _middle(2) {}
+
+    //! Allocates the arrays and forgets anything published. \note Must be synchronized with both threads.
+    void resize(size_t count)
+    {
+        for (std::vector<T>& buffer : _buffers)
+            buffer.assign(count, T());
+        _writeIndex = 0;
+        _readIndex = 1;
+        _middle = 2;
+    }
+
+    size_t getSize() const
+    {
+        return _buffers[0].size();
+    }
+
+    //! The array to fill before publish. \note Only safe to call from the write thread.
+    T* getWriteBuffer()
+    {
+        return _buffers[_writeIndex].data();
+    }
+
+    //! Hands the write array to the reader. \note Only safe to call from the write thread.
+    void publish()
+    {
+        uint8_t previous = _middle.exchange((uint8_t)_writeIndex | _fresh, std::memory_order_acq_rel);
+        _writeIndex = previous & ~_fresh;
+    }
+
+    //! Picks up the latest published array if there is one. \return whether the read array changed.
+    //! \note Only safe to call from the read thread.
+    bool update()
+    {
+        if ((_middle.load(std::memory_order_relaxed) & _fresh) == 0)
+            return false;
+        uint8_t previous = _middle.exchange((uint8_t)_readIndex, std::memory_order_acq_rel);
+        _readIndex = previous & ~_fresh;
+        return true;
+    }
+
+    //! The array update picked up last. \note Only safe to call from the read thread.
+    const T* getReadBuffer() const
+    {
+        return _buffers[_readIndex].data();
+    }
+};
+
+#endif /* TripleBuffer_h */